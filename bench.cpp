@@ -0,0 +1,361 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include "TRandom3.h"
+#include "inc/header.h"
+
+using namespace std;
+
+// synthetic data with the shapes of test-data/gen_data.cpp and gen_multid.cpp, generated in memory
+TRandom3 rndm;
+double lo = -10;
+double hi = 10;
+
+bool evt_sel(double x, double y)
+{
+	double r2 = x*x + y*y;
+	if (r2 > 120) return 0;
+	else return (rndm.Rndm() > 0.2*r2/120);
+}
+
+double gaus2d(double x, double y, double mx, double sx, double my, double sy, double rho)
+{
+	double tx = (x-mx)/sx;
+	double ty = (y-my)/sy;
+	return exp(-(tx*tx-2*rho*tx*ty+ty*ty)/2/(1-rho*rho));
+}
+
+double gen_gaus(double m, double s)
+{
+	double x = rndm.Gaus(m, s);
+	while (x < lo || x > hi) {
+		x = rndm.Gaus(m, s);
+	}
+	return x;
+}
+
+double gen_bw(double m, double w)
+{
+	double x = rndm.BreitWigner(m, w);
+	while (x < lo || x > hi) {
+		x = rndm.BreitWigner(m, w);
+	}
+	return x;
+}
+
+void gen_flat(dataset & d)
+{
+	for (size_t u = 0; u < d.size(); ++u) {
+		d.set_val(u, 0, rndm.Uniform(lo, hi));
+		d.set_weight(u, 1);
+	}
+}
+
+void gen_mix(dataset & d)
+{
+	for (size_t u = 0; u < d.size(); ++u) {
+		d.set_val(u, 0, rndm.Rndm() < 0.27 ? gen_gaus(0.3, 6.2) : gen_bw(2.5, 1.5));
+		d.set_weight(u, 1);
+	}
+}
+
+// x, y with the acceptance of gen_multid.cpp, weighted like its w1 branch if weighted is set
+void gen_multid(dataset & d, bool weighted)
+{
+	for (size_t u = 0; u < d.size(); ++u) {
+		double x, y;
+		do {
+			x = rndm.Uniform(lo, hi);
+			y = rndm.Uniform(lo, hi);
+		} while(!evt_sel(x, y));
+		d.set_val(u, 0, x);
+		d.set_val(u, 1, y);
+		d.set_weight(u, weighted ? gaus2d(x, y, 1, 3.5, -4.5, 1, -0.5) : 1);
+	}
+}
+
+class gaussian2d: public pdf
+{
+	public:
+		gaussian2d(variable & m1, variable & s1, variable & m2, variable & s2, variable & rho, dataset & normset):
+			pdf(2, {&m1, &s1, &m2, &s2, &rho}, normset) {}
+		virtual ~gaussian2d() {}
+		virtual double evaluate(const double * x) { return evaluate(x, get_pars().data()); }
+		virtual double evaluate(const double * x, const double * par);
+};
+
+double gaussian2d::evaluate(const double * x, const double * par)
+{
+	double tx = (x[0]-par[0])/par[1];
+	double ty = (x[1]-par[2])/par[3];
+	double rho = par[4];
+	return exp(-(tx*tx-2*rho*tx*ty+ty*ty)/2/(1-rho*rho));
+}
+
+class bw_proj: public projpdf
+{
+	public:
+		bw_proj(variable & m, variable & w, dataset & normset, size_t projdim, size_t nbin):
+			projpdf({&m, &w}, normset, projdim, nbin, lo, hi, {0}) {}
+		bw_proj(variable & m, variable & w, dataset & normset, const vector<size_t> & pdim, const vector<vector<double>> & binning):
+			projpdf({&m, &w}, normset, pdim, binning, {0}) {}
+		virtual ~bw_proj() {}
+		virtual double func_weight(const double * x) { return func_weight(x, get_pars().data()); }
+		virtual double func_weight(const double * x, const double * par);
+};
+
+double bw_proj::func_weight(const double * x, const double * par)
+{
+	return 1.0/((x[0]-par[0])*(x[0]-par[0])+0.25*par[1]*par[1]);
+}
+
+// runs func until it has taken 0.2 s (at least nmin times, at most 1000) and returns the mean time per call;
+// the call number is passed on so that parameters can be toggled to defeat the caches
+double measure(function<void(int)> func, int & nrep, int nmin = 3)
+{
+	double total = 0;
+	for (nrep = 0; nrep < nmin || (total < 0.2 && nrep < 1000); ++nrep) {
+		auto t0 = chrono::steady_clock::now();
+		func(nrep);
+		total += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	}
+	return total / nrep;
+}
+
+// largest error of vecmath::exp or log in mode m against expl/logl over n points spread log- or linearly
+// in [lo, hi], in ulp of the double result, relative and absolute; checked against the bound documented in
+// vecmath.h (strict: 1 ulp, fast: relative 1e-11 for exp, absolute 2e-11 for log, libm is not checked) and
+// written as one json line. Returns false if the bound is exceeded
+bool accuracy(ostream & json, const char * name, bool is_exp, vecmath::mode m, double lo, double hi, bool logspace, size_t n = 1000000)
+{
+	vector<double> x(n), y(n);
+	for (size_t u = 0; u < n; ++u) {
+		double t = (u+0.5)/n;
+		x[u] = logspace ? exp(log(lo)+(log(hi)-log(lo))*t) : lo+(hi-lo)*t;
+	}
+	if (is_exp) vecmath::exp(&x[0], &y[0], n, m);
+	else vecmath::log(&x[0], &y[0], n, m);
+	double max_ulp = 0, max_rel = 0, max_abs = 0;
+	for (size_t u = 0; u < n; ++u) {
+		long double ref = is_exp ? expl(x[u]) : logl(x[u]);
+		if (ref == 0) continue;
+		double d = fabs(double(y[u]-ref));
+		double ulp = nextafter(fabs(double(ref)), INFINITY)-fabs(double(ref));
+		max_ulp = d/ulp > max_ulp ? d/ulp : max_ulp;
+		max_abs = d > max_abs ? d : max_abs;
+		if (fabs(double(ref)) < 0x1p-1022) continue; // subnormal results have fewer significant bits
+		max_rel = d/fabs(double(ref)) > max_rel ? d/fabs(double(ref)) : max_rel;
+	}
+
+	const char * mname[] = {"libm", "strict", "fast"};
+	const char * bname = "none";
+	double bound = 0, err = 0;
+	if (m == vecmath::strict) { bname = "ulp"; bound = 1; err = max_ulp; }
+	else if (m == vecmath::fast && is_exp) { bname = "relative"; bound = 1e-11; err = max_rel; }
+	else if (m == vecmath::fast) { bname = "absolute"; bound = 2e-11; err = max_abs; }
+	bool ok = !(err > bound) && err == err;
+	cout << "[bench] " << setw(16) << left << name << right << " " << setw(6) << mname[m] << " on [" << lo << ", " << hi << "]";
+	cout << "  max " << max_ulp << " ulp, relative " << max_rel << ", absolute " << max_abs;
+	if (m != vecmath::libm) cout << "  (bound " << bound << " " << bname << (ok ? ", ok)" : ", exceeded)");
+	cout << endl;
+	if (!ok) cout << "[bench] error: " << name << " in " << mname[m] << " mode exceeds its documented error bound" << endl;
+	json << "{\"name\": \"accuracy_" << name << "\", \"mode\": \"" << mname[m] << "\", \"lo\": " << lo << ", \"hi\": " << hi;
+	json << ", \"max_ulp\": " << max_ulp << ", \"max_rel\": " << max_rel << ", \"max_abs\": " << max_abs;
+	json << ", \"bound\": " << bound << ", \"bound_type\": \"" << bname << "\", \"pass\": " << (ok ? "true" : "false") << "}" << endl;
+	return ok;
+}
+
+// the packed-parameter evaluate of an addpdf, which chi2fcn uses, against the plain one for three components,
+// at the starting point and at the result of a chi2 fit; returns false on a mismatch
+bool check_addpdf()
+{
+	dataset norm(10000, 1), data(10000, 1);
+	gen_flat(norm);
+	gen_mix(data);
+	TH1F * h = new TH1F("h_check", "", 40, lo, hi);
+	data.draw(h);
+	datahist hist(h);
+
+	variable m1("m1", 0.3, -10, 10);
+	variable s1("s1", 6, 0.3, 20);
+	variable m2("m2", 2.5, -10, 10);
+	variable w("w", 1.5, 0.3, 20);
+	variable m3("m3", -3, -10, 10);
+	variable s3("s3", 2, 0.3, 20);
+	variable f1("f1", 0.3, 0, 1);
+	variable f2("f2", 0.5, 0, 1);
+	gaussian gaus1(m1, s1, norm);
+	breitwigner bw(m2, w, norm);
+	gaussian gaus3(m3, s3, norm);
+	addpdf sum({&gaus1, &bw, &gaus3}, {&f1, &f2});
+
+	bool ok = true;
+	for (int pass = 0; pass < 2; ++pass) {
+		if (pass) sum.chi2fit(hist);
+		sum.norm();
+		vector<double> par = sum.get_pars();
+		double maxdiff = 0;
+		for (size_t u = 0; u < norm.size(); u += 10) {
+			double v = sum.evaluate(norm.at(u));
+			double d = fabs(sum.evaluate(norm.at(u), par.data())-v)/v;
+			maxdiff = d > maxdiff ? d : maxdiff;
+		}
+		cout << "[bench] addpdf evaluate(x, par) vs evaluate(x) " << (pass ? "after chi2fit" : "at start");
+		cout << ": max relative difference " << maxdiff << endl;
+		if (!(maxdiff < 1e-12)) {
+			cout << "[bench] error: addpdf evaluate(x, par) does not match evaluate(x)" << endl;
+			ok = false;
+		}
+	}
+	delete h;
+	return ok;
+}
+
+// the variables after a fit (MIGRAD then HESSE, serial and parallel derivatives) against the minimum minuit
+// reports; returns false if a value was left elsewhere
+bool check_fit_values()
+{
+	dataset norm(10000, 1), data(2000, 1);
+	gen_flat(norm);
+	gen_mix(data);
+	variable m("m", 1, -10, 10);
+	variable s("s", 4, 0.3, 20);
+	variable w("w", 4, 0.3, 20);
+	variable f("f", 0.3, 0, 1);
+	gaussian gaus(m, s, norm);
+	breitwigner bw(m, w, norm);
+	addpdf sum({&gaus, &bw}, {&f});
+
+	bool ok = true;
+	for (bool pderiv: {false, true}) {
+		nllfcn * nll = sum.create_nll(&data);
+		nll->set_verbose(false);
+		nll->set_parallel_derivatives(pderiv);
+		nll->minimize();
+		vector<double> par = nll->min_pars();
+		double maxdiff = 0;
+		for (size_t u = 0; u < par.size(); ++u) {
+			maxdiff = max(maxdiff, fabs(nll->get_var(u)->value()-par[u]));
+		}
+		cout << "[bench] values after fit" << (pderiv ? " (parallel derivatives)" : "") << " vs minimum: max difference " << maxdiff << endl;
+		if (par.empty() || maxdiff != 0) {
+			cout << "[bench] error: the variables are not left at the minimum after the fit" << endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+int bench(const char * output = "bench.json", size_t max_nevt = 1000000)
+{
+	int nfail = 0;
+	if (!check_addpdf()) ++nfail;
+	if (!check_fit_values()) ++nfail;
+
+	ofstream json(output);
+	auto record = [&](const char * name, size_t nevt, size_t dim, size_t nthread, function<void(int)> func, int nmin) {
+		int nrep = 0;
+		double t = measure(func, nrep, nmin);
+		cout << "[bench] " << setw(16) << left << name << right << " nevt " << setw(8) << nevt << " dim " << dim;
+		cout << " threads " << setw(3) << nthread << "  " << setw(12) << t*1e3 << " ms (" << nrep << " calls)" << endl;
+		json << "{\"name\": \"" << name << "\", \"nevt\": " << nevt << ", \"dim\": " << dim << ", \"nthread\": " << nthread;
+		json << ", \"time\": " << t << ", \"nrep\": " << nrep << "}" << endl;
+	};
+
+	vector<size_t> threads = {1};
+	for (size_t n = 2; n < thread::hardware_concurrency(); n *= 2) threads.push_back(n);
+	if (thread::hardware_concurrency() > 1) threads.push_back(thread::hardware_concurrency());
+
+	// the ranges of the fits: log of pdf values, exp of gaussian exponents
+	for (vecmath::mode md: {vecmath::libm, vecmath::strict, vecmath::fast}) {
+		if (!accuracy(json, "exp", true, md, -745, 0, false)) ++nfail;
+		if (!accuracy(json, "exp", true, md, -50, 0, false)) ++nfail;
+		if (!accuracy(json, "log", false, md, 1e-300, 1e300, true)) ++nfail;
+		if (!accuracy(json, "log", false, md, 1e-12, 1e3, true)) ++nfail;
+	}
+	vector<double> vin(1000000), vout(1000000);
+	for (size_t u = 0; u < vin.size(); ++u) vin[u] = -50*rndm.Rndm();
+	for (vecmath::mode md: {vecmath::libm, vecmath::strict, vecmath::fast}) {
+		const char * ename[] = {"exp_libm", "exp_strict", "exp_fast"};
+		const char * lname[] = {"log_libm", "log_strict", "log_fast"};
+		record(ename[md], vin.size(), 1, 1, [&](int r) { vecmath::exp(&vin[0], &vout[0], vin.size(), md); }, 3);
+		record(lname[md], vin.size(), 1, 1, [&](int r) { vecmath::log(&vout[0], &vin[0], vout.size(), md); }, 3);
+	}
+
+	variable m("m", 1, -10, 10);
+	variable s("s", 4, 0.3, 20);
+	variable w("w", 4, 0.3, 20);
+	variable f("f", 0.3, 0, 1);
+	variable m2("m2", -4, -10, 10);
+	variable s2("s2", 1, 0.1, 20);
+	variable rho("rho", -0.5, -0.999, 0.999);
+	auto toggle = [&](int r) { m.set_value(1+1e-3*(r%2)); };
+	auto reset = [&]() { m.set_value(1); s.set_value(4); w.set_value(4); f.set_value(0.3); m2.set_value(-4); s2.set_value(1); rho.set_value(-0.5); };
+
+	for (size_t nevt = 10000; nevt <= max_nevt; nevt *= 10) {
+		dataset norm(nevt, 1), data(nevt/10, 1);
+		dataset norm_2d(nevt, 2), data_2d(nevt/10, 2);
+		gen_flat(norm);
+		gen_mix(data);
+		gen_multid(norm_2d, false);
+		gen_multid(data_2d, true);
+
+		TH1F * h = new TH1F("h_bench", "", 100, lo, hi);
+		TH2F * h2 = new TH2F("h2_bench", "", 50, lo, hi, 50, lo, hi);
+		data.draw(h);
+		data_2d.draw(h2);
+		datahist hist(h);
+		datahist hist_2d(h2);
+
+		gaussian gaus(m, s, norm);
+		breitwigner bw(m, w, norm);
+		addpdf sum({&gaus, &bw}, {&f});
+		gaussian2d gaus_2d(m, s, m2, s2, rho, norm_2d);
+		vector<double> edge;
+		for (int u = 0; u <= 50; ++u) edge.push_back(lo+u*(hi-lo)/50);
+		bw_proj proj(m, w, norm_2d, 0, 100);
+		bw_proj proj_2d(m, w, norm_2d, {0, 1}, {edge, edge});
+		double x[2] = {0.5, -4.5};
+
+		for (size_t nthread: threads) {
+			parallel::set_nthread(nthread);
+			reset();
+			record("log_sum", data.size(), 1, nthread, [&](int r) { gaus.log_sum(&data); }, 3);
+			record("norm", norm.size(), 1, nthread, [&](int r) { toggle(r); gaus.norm(); }, 3);
+			record("integral", norm.size(), 1, nthread, [&](int r) { toggle(r); gaus.integral(-1, 1); }, 3);
+			record("addpdf_log_sum", data.size(), 1, nthread, [&](int r) { toggle(r); sum.log_sum(&data); }, 3);
+			record("log_sum_2d", data_2d.size(), 2, nthread, [&](int r) { toggle(r); gaus_2d.log_sum(&data_2d); gaus_2d.norm(); }, 3);
+
+			chi2fcn chi2(&gaus, &hist);
+			chi2fcn chi2_2d(&gaus_2d, &hist_2d);
+			record("chi2fcn", norm.size(), 1, nthread, [&](int r) { chi2({1+1e-3*(r%2), 4}); }, 3);
+			record("chi2fcn_2d", norm_2d.size(), 2, nthread, [&](int r) { chi2_2d({1+1e-3*(r%2), 4, -4, 1, -0.5}); }, 3);
+			record("projpdf", norm_2d.size(), 1, nthread, [&](int r) { toggle(r); proj.evaluate(x); }, 3);
+			record("projpdf_2d", norm_2d.size(), 2, nthread, [&](int r) { toggle(r); proj_2d.evaluate(x); }, 3);
+
+			record("fit", data.size(), 1, nthread, [&](int r) { reset(); sum.fit(data); }, 1);
+			record("fit_2d", data_2d.size(), 2, nthread, [&](int r) { reset(); gaus_2d.fit(data_2d); }, 1);
+			record("fit_pderiv", data.size(), 1, nthread, [&](int r) {
+				reset();
+				nllfcn * nll = sum.create_nll(&data);
+				nll->set_parallel_derivatives(true);
+				nll->minimize();
+			}, 1);
+		}
+		delete h;
+		delete h2;
+	}
+	reset();
+	cout << "[bench] results written to " << output << endl;
+	if (nfail) cout << "[bench] error: " << nfail << " checks failed" << endl;
+	return nfail;
+}
+
+#if !defined(__CLING__) && !defined(__ACLIC__)
+int main(int argc, char ** argv)
+{
+	return bench(argc > 1 ? argv[1] : "bench.json", argc > 2 ? atol(argv[2]) : 1000000) ? 1 : 0;
+}
+#endif
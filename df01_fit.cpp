@@ -14,9 +14,17 @@ void df01_fit()
 	TTree * t_gaus = (TTree *)f2->Get("t");
 	TTree * t_bw   = (TTree *)f3->Get("t");
 
-	dataset data_norm(t_flat, {"x"});
-	dataset data_gaus(t_gaus, {"x"});
-	dataset data_bw(t_bw, {"x"});
+	// the three files are read at the same time, the gaussian fit starts on the events already loaded
+	std::shared_ptr<dataset> load_norm = dataset::load(t_flat, {"x"});
+	std::shared_ptr<dataset> load_gaus = dataset::load(t_gaus, {"x"});
+	std::shared_ptr<dataset> load_bw = dataset::load(t_bw, {"x"});
+	if (!load_norm || !load_gaus || !load_bw) {
+		cout << "error: cannot load the test data" << endl;
+		return;
+	}
+	dataset & data_norm = *load_norm;
+	dataset & data_gaus = *load_gaus;
+	dataset & data_bw = *load_bw;
 	
 	cout << "********************* gaussian ********************" << endl;
 	variable m("m", 1, -10, 10);
@@ -11,6 +11,7 @@ class gaussian2d: public pdf
 		gaussian2d(variable & m1, variable & s1, variable & m2, variable & s2, variable & rho, dataset & normset);
 		virtual ~gaussian2d() {}
 		virtual double evaluate(const double * x);
+		virtual double evaluate(const double * x, const double * par);
 };
 
 gaussian2d::gaussian2d(variable & m1, variable & s1, variable & m2, variable & s2, variable & rho, dataset & normset):
@@ -20,11 +21,17 @@ gaussian2d::gaussian2d(variable & m1, variable & s1, variable & m2, variable & s
 
 double gaussian2d::evaluate(const double * x)
 {
-	double mx = get_par(0);
-	double sx = get_par(1);
-	double my = get_par(2);
-	double sy = get_par(3);
-	double rho = get_par(4);
+	return evaluate(x, get_pars().data());
+}
+
+// used in fits: the parameters come packed, looked up once per batch of events
+double gaussian2d::evaluate(const double * x, const double * par)
+{
+	double mx = par[0];
+	double sx = par[1];
+	double my = par[2];
+	double sy = par[3];
+	double rho = par[4];
 	double tx = (x[0]-mx)/sx;
 	double ty = (x[1]-my)/sy;
 	return exp(-(tx*tx-2*rho*tx*ty+ty*ty)/2/(1-rho*rho));
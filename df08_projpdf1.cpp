@@ -15,12 +15,12 @@ class bw_proj: public projpdf
 };
 
 bw_proj::bw_proj(variable & m, variable & w, dataset & normset, size_t projdim, size_t nbin, double lo, double hi):
-	projpdf({&m, &w}, normset, projdim, nbin, lo, hi)
+	projpdf({&m, &w}, normset, projdim, nbin, lo, hi, {0})
 {
 }
 
 bw_proj::bw_proj(variable & m, variable & w, dataset & normset, size_t projdim, size_t nbin, const double * binning):
-	projpdf({&m, &w}, normset, projdim, nbin, binning)
+	projpdf({&m, &w}, normset, projdim, nbin, binning, {0})
 {
 }
 
@@ -41,12 +41,12 @@ class gaus_proj: public projpdf
 };
 
 gaus_proj::gaus_proj(variable & m, variable & s, dataset & normset, size_t projdim, size_t nbin, double lo, double hi):
-	projpdf({&m, &s}, normset, projdim, nbin, lo, hi)
+	projpdf({&m, &s}, normset, projdim, nbin, lo, hi, {1})
 {
 }
 
 gaus_proj::gaus_proj(variable & m, variable & s, dataset & normset, size_t projdim, size_t nbin, const double * binning):
-	projpdf({&m, &s}, normset, projdim, nbin, binning)
+	projpdf({&m, &s}, normset, projdim, nbin, binning, {1})
 {
 }
 
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <iomanip>
+#include "TRandom3.h"
+#include "inc/header.h"
+
+using namespace std;
+
+class bw_gaus_proj: public projpdf
+{
+	public:
+		bw_gaus_proj(variable & mx, variable & wx, variable & my, variable & sy, dataset & normset, const vector<vector<double>> & binning);
+		virtual ~bw_gaus_proj() {}
+		virtual double func_weight(const double * x);
+};
+
+bw_gaus_proj::bw_gaus_proj(variable & mx, variable & wx, variable & my, variable & sy, dataset & normset, const vector<vector<double>> & binning):
+	projpdf({&mx, &wx, &my, &sy}, normset, {0, 1}, binning)
+{
+}
+
+double bw_gaus_proj::func_weight(const double * x)
+{
+	double mx = get_par(0);
+	double wx = get_par(1);
+	double my = get_par(2);
+	double sy = get_par(3);
+	double b = 1.0/((x[0]-mx)*(x[0]-mx)+0.25*wx*wx);
+	double g = exp(-(x[1]-my)*(x[1]-my)/2/sy/sy);
+	return b*g;
+}
+
+void df10_projpdf2d()
+{
+	TFile * f = TFile::Open("test-data/weighted_2d.root");
+	TTree * t = (TTree *)f->Get("t");
+
+	TH2F * h = new TH2F("h", "", 20, -10, 10, 20, -10, 10);
+	t->Draw("y:x>>h", "w2", "goff");
+	
+	dataset data_2d_norm(t, {"x", "y"});
+	datahist data_2d(h);
+
+	vector<double> binning;
+	for (int u = 0; u <= 20; ++u) {
+		binning.push_back(-10 + u);
+	}
+
+	variable mx("mx", 1, -10, 10);
+	variable wx("wx", 4, 0.1, 20);
+	variable my("my", 1, -10, 10);
+	variable sy("sy", 4, 0.1, 20);
+	bw_gaus_proj bg(mx, wx, my, sy, data_2d_norm, {binning, binning});
+	bg.chi2fit(data_2d);
+
+	TCanvas * c = new TCanvas("c", "", 1600, 800);
+	c->Divide(2, 1);
+	c->cd(1);
+	h->Draw("colz");
+	c->cd(2);
+	TH2F * h2 = new TH2F("h2", "", 20, -10, 10, 20, -10, 10);
+	bg.draw(h2, h, "colz");
+}
@@ -0,0 +1,33 @@
+#ifdef __CLING__
+
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+
+#pragma link C++ class addpdf;
+#pragma link C++ class breitwigner;
+#pragma link C++ class chi2fcn;
+#pragma link C++ class context;
+#pragma link C++ class datahist;
+#pragma link C++ class dataset;
+#pragma link C++ class fcn;
+#pragma link C++ class fitresult;
+#pragma link C++ class gaussian;
+#pragma link C++ class gradfcn;
+#pragma link C++ class nllfcn;
+#pragma link C++ class numa;
+#pragma link C++ class parallel;
+#pragma link C++ class pdf;
+#pragma link C++ class profiler;
+#pragma link C++ class projection;
+#pragma link C++ class projindex;
+#pragma link C++ class projpdf;
+#pragma link C++ class sampler;
+#pragma link C++ class scan;
+#pragma link C++ class simfit;
+#pragma link C++ class toymc;
+#pragma link C++ class tracer;
+#pragma link C++ class variable;
+#pragma link C++ class vecmath;
+
+#endif
@@ -1,9 +1,12 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include "TMath.h"
 #include "chi2fcn.h"
 #include "datahist.h"
 #include "dataset.h"
 #include "addpdf.h"
+#include "projection.h"
 #include "variable.h"
 
 addpdf::addpdf(const std::vector<pdf *> plist, const std::vector<variable *> flist):
@@ -22,6 +25,17 @@ addpdf::~addpdf()
 {
 }
 
+// largest error among the components
+double addpdf::binned_norm_error()
+{
+	double err = 0;
+	for (pdf * p: m_plist) {
+		double e = p->binned_norm_error();
+		if (fabs(e) > fabs(err)) err = e;
+	}
+	return err;
+}
+
 void addpdf::calculate_frac()
 {
 	double ftot = 0;
@@ -32,62 +46,151 @@ void addpdf::calculate_frac()
 	m_frac[m_flist.size()] = 1-ftot;
 }
 
-void addpdf::draw_comp(TH1 * h, size_t n, TH1 * hnorm = 0, const char * option)
+void addpdf::draw_comp(TH1 * h, size_t n, TH1 * hnorm, const char * option)
 {
-	if (m_dim && n < m_plist.size()) {
-		pdf * p = m_plist[n];
-		h->Reset();
-		for (size_t u = 0; u < m_normset->size(); ++u) {
-			double v = p->evaluate(m_normset->at(u)) * m_normset->weight(u);
-			h->Fill(m_normset->at(u)[0], v);
-		}
-		if (hnorm) h->Scale(hnorm->Integral() / h->Integral());
-		calculate_frac();
-		h->Scale(m_frac[n]);
-		for (int u = 1; u <= h->GetNbinsX(); ++u) {
-			h->SetBinError(u, 0);
+	std::vector<TH1 *> hlist(m_plist.size(), 0);
+	if (n < m_plist.size()) hlist[n] = h;
+	draw_comp(hlist, hnorm, option);
+}
+
+void addpdf::draw_comp(TH2 * h, size_t n, TH2 * hnorm, const char * option)
+{
+	std::vector<TH2 *> hlist(m_plist.size(), 0);
+	if (n < m_plist.size()) hlist[n] = h;
+	draw_comp(hlist, hnorm, option);
+}
+
+// all components in one pass over the normset, h[n] is the histogram of component n (0 to skip it)
+void addpdf::draw_comp(const std::vector<TH1 *> & h, TH1 * hnorm, const char * option)
+{
+	if (!m_dim) return;
+	projection proj(m_normset);
+	for (size_t n = 0; n < h.size() && n < m_plist.size(); ++n) {
+		if (h[n]) proj.add(h[n], 0, m_plist[n], false);
+	}
+	proj.fill();
+	calculate_frac();
+	for (size_t n = 0; n < h.size() && n < m_plist.size(); ++n) {
+		if (!h[n]) continue;
+		if (hnorm) h[n]->Scale(hnorm->Integral() / h[n]->Integral());
+		h[n]->Scale(m_frac[n]);
+		for (int u = 1; u <= h[n]->GetNbinsX(); ++u) {
+			h[n]->SetBinError(u, 0);
 		}
-		h->Draw(option);
+		h[n]->Draw(option);
 	}
 }
 
-void addpdf::draw_comp(TH2 * h, size_t n, TH2 * hnorm = 0, const char * option)
+void addpdf::draw_comp(const std::vector<TH2 *> & h, TH2 * hnorm, const char * option)
 {
-	if (m_dim && n < m_plist.size()) {
-		pdf * p = m_plist[n];
-		h->Reset();
-		for (size_t u = 0; u < m_normset->size(); ++u) {
-			double v = p->evaluate(m_normset->at(u)) * m_normset->weight(u);
-			h->Fill(m_normset->at(u)[0], m_normset->at(u)[1], v);
-		}
-		if (hnorm) h->Scale(hnorm->Integral() / h->Integral());
-		calculate_frac();
-		h->Scale(m_frac[n]);
-		for (int u = 1; u <= h->GetNbinsX(); ++u) {
-			for (int v = 1; v <= h->GetNbinsY(); ++v) {
-				h->SetBinError(u, v, 0);
+	if (m_dim < 2) {
+		std::cout << "[pdf] error: 1d pdf cannot plot 2d hist" << std::endl;
+		return;
+	}
+	projection proj(m_normset);
+	for (size_t n = 0; n < h.size() && n < m_plist.size(); ++n) {
+		if (h[n]) proj.add(h[n], 0, 1, m_plist[n], false);
+	}
+	proj.fill();
+	calculate_frac();
+	for (size_t n = 0; n < h.size() && n < m_plist.size(); ++n) {
+		if (!h[n]) continue;
+		if (hnorm) h[n]->Scale(hnorm->Integral() / h[n]->Integral());
+		h[n]->Scale(m_frac[n]);
+		for (int u = 1; u <= h[n]->GetNbinsX(); ++u) {
+			for (int v = 1; v <= h[n]->GetNbinsY(); ++v) {
+				h[n]->SetBinError(u, v, 0);
 			}
 		}
-		h->Draw(option);
-	}
-	else {
-		std::cout << "[pdf] error: 1d pdf cannot plot 2d hist" << std::endl;
+		h[n]->Draw(option);
 	}
 }
 
+// fractions are read locally rather than through m_frac, so that evaluate can run on several threads
 double addpdf::evaluate(const double * x)
 {
-	calculate_frac();
 	double v = 0;
+	double ftot = 0;
 	for (size_t u = 0; u < m_plist.size(); ++u) {
-		double f = m_frac[u];
+		double f = (u < m_flist.size()) ? m_flist[u]->value() : 1-ftot;
 		double raw = m_plist.at(u)->evaluate(x);
 		double scale = m_plist.at(u)->norm();
+		ftot += f;
 		v += f * scale * raw;
 	}
 	return v;
 }
 
+// par is packed like the parameter list: the parameters of each component in turn, then the fractions; the
+// component norms are looked up per call, loops over events go through evaluate_batch or evaluate_indexed
+double addpdf::evaluate(const double * x, const double * par)
+{
+	double v = 0;
+	double ftot = 0;
+	size_t nf = m_varlist.size()-m_flist.size();
+	const double * cpar = par;
+	for (size_t u = 0; u < m_plist.size(); ++u) {
+		double f = (u < m_flist.size()) ? par[nf+u] : 1-ftot;
+		double raw = m_plist[u]->evaluate(x, cpar);
+		cpar += m_plist[u]->npar();
+		ftot += f;
+		v += f * m_plist[u]->norm() * raw;
+	}
+	return v;
+}
+
+// fractions and component norms are looked up once per batch instead of once per event, components without
+// floating parameters are read from their precomputed arrays when there are some
+void addpdf::evaluate_batch(dataset * data, size_t begin, size_t end, double * out)
+{
+	std::fill(out, out+(end-begin), 0);
+	std::vector<double> val(end-begin);
+	double ftot = 0;
+	for (size_t u = 0; u < m_plist.size(); ++u) {
+		double f = (u < m_flist.size()) ? m_flist[u]->value() : 1-ftot;
+		double scale = f * m_plist[u]->norm();
+		ftot += f;
+		if (!m_plist[u]->get_precomputed(data, begin, end, &val[0])) {
+			m_plist[u]->evaluate_batch(data, begin, end, &val[0]);
+		}
+		for (size_t v = 0; v < end-begin; ++v) {
+			out[v] += scale * val[v];
+		}
+	}
+}
+
+// as evaluate_batch, the fractions and component norms are looked up once for all the events
+void addpdf::evaluate_indexed(dataset * data, const std::vector<size_t> & index, double * out)
+{
+	std::fill(out, out+index.size(), 0);
+	std::vector<double> val(index.size());
+	double ftot = 0;
+	for (size_t u = 0; u < m_plist.size(); ++u) {
+		double f = (u < m_flist.size()) ? m_flist[u]->value() : 1-ftot;
+		double scale = f * m_plist[u]->norm();
+		ftot += f;
+		m_plist[u]->evaluate_indexed(data, index, val.data());
+		for (size_t k = 0; k < index.size(); ++k) {
+			out[k] += scale * val[k];
+		}
+	}
+}
+
+// components are normalized here, ahead of any evaluation, so that several threads summing pieces of one
+// dataset only read their cached norms; they share the normset, which is traversed once for all of them
+double addpdf::norm()
+{
+	std::vector<std::pair<pdf *, context *>> plist;
+	for (pdf * p: m_plist) {
+		plist.push_back(std::make_pair(p, (context *)0));
+	}
+	normalize_all(plist);
+	for (pdf * p: m_plist) {
+		p->norm();
+	}
+	return 1;
+}
+
 void addpdf::init()
 {
 	for (pdf * p: m_plist) {
@@ -98,25 +201,53 @@ void addpdf::init()
 			std::cout << "[addpdf] error: all pdf must have the same normset" << std::endl;
 		}
 		m_varlist.insert(m_varlist.end(), p->get_vars().begin(), p->get_vars().end());
-		m_lastvalue.insert(m_lastvalue.end(), p->get_lastvalues().begin(), p->get_lastvalues().end());
+		m_cache.lastvalue.insert(m_cache.lastvalue.end(), p->get_lastvalues().begin(), p->get_lastvalues().end());
 	}
 	for (variable * v: m_flist) {
 		m_varlist.push_back(v);
-		m_lastvalue.push_back(v->value()-0.1);
+		m_cache.lastvalue.push_back(v->value()-0.1);
 	}
 }
 
 double addpdf::integral(double a, double b, int n)
 {
-	calculate_frac();
 	double tot = 0;
+	double ftot = 0;
 	for (size_t u = 0; u < m_plist.size(); ++u) {
-		double f = m_frac[u];
+		double f = (u < m_flist.size()) ? m_flist[u]->value() : 1-ftot;
+		ftot += f;
 		tot += f * m_plist[u]->integral(a, b, n);
 	}
 	return tot;
 }
 
+// components are normalized for all points in one pass over the normset, evaluate then only reads their cached norms
+std::vector<double> addpdf::norm(const std::vector<context *> & ctx)
+{
+	std::vector<std::pair<pdf *, context *>> plist;
+	for (context * c: ctx) {
+		for (pdf * p: m_plist) {
+			plist.push_back(std::make_pair(p, c));
+		}
+	}
+	normalize_all(plist);
+	for (pdf * p: m_plist) {
+		p->norm(ctx);
+	}
+	return std::vector<double>(ctx.size(), 1);
+}
+
+// the components share the normset and therefore one surrogate, the largest of their errors is returned
+double addpdf::set_binned_norm(size_t nbin, bool mean)
+{
+	double err = 0;
+	for (pdf * p: m_plist) {
+		double e = p->set_binned_norm(nbin, mean);
+		if (fabs(e) > fabs(err)) err = e;
+	}
+	return err;
+}
+
 void addpdf::set_normset(dataset & normset)
 {
 	m_normset = &normset;
@@ -4,6 +4,7 @@
 #include <vector>
 #include "pdf.h"
 
+class context;
 class dataset;
 class variable;
 
@@ -16,12 +17,21 @@ class addpdf: public pdf
 		void calculate_frac();
 		void draw_comp(TH1 * h, size_t n, TH1 * hnorm = 0, const char * option = "hist same");
 		void draw_comp(TH2 * h, size_t n, TH2 * hnorm = 0, const char * option = "hist same");
+		void draw_comp(const std::vector<TH1 *> & h, TH1 * hnorm = 0, const char * option = "hist same");
+		void draw_comp(const std::vector<TH2 *> & h, TH2 * hnorm = 0, const char * option = "hist same");
 		
 		// override pdf
+		virtual double binned_norm_error();
+		virtual std::vector<pdf *> components() { return m_plist; }
 		virtual double evaluate(const double * x);
+		virtual double evaluate(const double * x, const double * par);
+		virtual void evaluate_batch(dataset * data, size_t begin, size_t end, double * out);
+		virtual void evaluate_indexed(dataset * data, const std::vector<size_t> & index, double * out);
 		virtual double integral(double a, double b, int n = 0);
-		virtual double norm() { return 1; }
+		virtual double norm();
+		virtual std::vector<double> norm(const std::vector<context *> & ctx);
 		virtual bool normalized() { return true; }
+		virtual double set_binned_norm(size_t nbin, bool mean = true);
 		virtual void set_normset(dataset & normset);
 
 	protected:
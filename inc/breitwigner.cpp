@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cmath>
+#include "TMath.h"
 #include "dataset.h"
 #include "breitwigner.h" 
 
@@ -12,6 +13,15 @@ breitwigner::~breitwigner()
 {
 }
 
+// integral of 1/((t-m)^2+w^2/4) over [lo, hi]
+bool breitwigner::analytic_integral(const double * lo, const double * hi, double & value)
+{
+	double m = get_par(0);
+	double w = get_par(1);
+	value = 2/w*(TMath::ATan(2*(hi[0]-m)/w) - TMath::ATan(2*(lo[0]-m)/w));
+	return true;
+}
+
 double breitwigner::evaluate(const double * x)
 {
 	double t = x[0];
@@ -19,3 +29,21 @@ double breitwigner::evaluate(const double * x)
 	double w = get_par(1);
 	return 1.0/((t-m)*(t-m)+0.25*w*w);
 }
+
+double breitwigner::evaluate(const double * x, const double * par)
+{
+	double t = x[0]-par[0];
+	return 1.0/(t*t+0.25*par[1]*par[1]);
+}
+
+// w^2/4 is calculated once for the batch
+void breitwigner::evaluate_batch(dataset * data, size_t begin, size_t end, double * out)
+{
+	double m = get_par(0);
+	double w = get_par(1);
+	double c = 0.25*w*w;
+	for (size_t u = begin; u < end; ++u) {
+		double t = data->at(u)[0]-m;
+		out[u-begin] = 1.0/(t*t+c);
+	}
+}
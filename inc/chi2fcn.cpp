@@ -1,9 +1,14 @@
 #include <iostream>
+#include <chrono>
 #include <cmath>
 #include "chi2fcn.h"
+#include "context.h"
 #include "datahist.h"
 #include "fcn.h"
+#include "parallel.h"
 #include "pdf.h"
+#include "profiler.h"
+#include "tracer.h"
 #include "variable.h"
 
 chi2fcn::chi2fcn(pdf * p, datahist * d):
@@ -22,60 +27,132 @@ void chi2fcn::add(pdf * p, datahist * d)
 	update_data(p, d);
 }
 
-double chi2fcn::operator()(const std::vector<double> & par) const
+fcn * chi2fcn::clone() const
 {
-	double chi2 = 0;
+	chi2fcn * f = new chi2fcn(*this);
+	f->reset_channels();
+	return f;
+}
 
+// channels (histograms) are evaluated concurrently, the most expensive ones handed out first
+double chi2fcn::operator()(const std::vector<double> & par) const
+{
 	for (size_t u = 0; u < m_varlist.size(); ++u) {
 		m_varlist[u]->set_value(par[u]);
 		//std::cout << u << " " << par[u] << std::endl;
 	}
 
+	count_call();
+	PROFILE_SCOPE(this, "chi2");
+	prepare_channels();
 	for (size_t u = 0; u < m_pdflist.size(); ++u) {
-		pdf * p = m_pdflist.at(u);
-		datahist * d = dynamic_cast<datahist *>(m_datalist.at(u));
-		
-		double nfit_tot = 0;
-		std::vector<double> nfit_vec(d->size(), 0);
-		for (size_t v = 0; v < d->size(); ++v) {
-			for (size_t w = 0; w < m_data[u][v].size(); ++w) {
-				nfit_vec[v] += p->evaluate(m_data[u][v][w]);
-			}
-			nfit_tot += nfit_vec[v];
-		}
-		
-		double nevt = d->nevt();
-		for (size_t v = 0; v < d->size(); ++v) {
-			double nobs = d->weight(v);
-			double err_u = d->err_up(v);
-			double err_d = d->err_down(v);
-			double nfit = nevt * nfit_vec[v] / nfit_tot;
-			
-			if (nfit > nobs && err_u) {
-				chi2 += pow(nfit-nobs, 2)/err_u/err_u;
-			}
-			else if (nfit < nobs && err_d) {
-				chi2 += pow(nfit-nobs, 2)/err_d/err_d;
-			}
-			else if (nfit) {
-				chi2 += pow(nfit-nobs, 2)/nfit;
-			}
+		bin_events(u);
+	}
+	std::vector<size_t> all;
+	for (size_t u = 0; u < m_pdflist.size(); ++u) {
+		all.push_back(u);
+		count_eval(u);
+	}
+	std::vector<size_t> todo = schedule(all);
+
+	// chi2 takes the normalization from the histogram, only the components of an addpdf need their norms;
+	// components on the same normset are normalized in one pass over it
+	std::vector<std::pair<pdf *, context *>> plist;
+	for (size_t u: todo) {
+		for (pdf * p: m_pdflist[u]->components()) {
+			plist.push_back(std::make_pair(p, channel_context(u)));
 		}
 	}
+	pdf::normalize_all(plist);
+
+	std::vector<double> chi2_vec(m_pdflist.size(), 0);
+	parallel::for_each(todo.size(), [&](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; ++k) {
+			size_t u = todo[k];
+			tracer::span span("channel", "chi2", "channel", u);
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			context * c = channel_context(u);
+			if (c) c->activate();
+			chi2_vec[u] = channel_chi2(u);
+			if (c) c->deactivate();
+			m_cost[u] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		}
+	});
 
+	double chi2 = 0;
+	for (double v: chi2_vec) {
+		chi2 += v;
+	}
 	return chi2;
 }
 
-void chi2fcn::update_data(pdf * p, datahist * d)
+double chi2fcn::channel_chi2(size_t u) const
 {
+	PROFILE_SCOPE(this, "chi2 channel");
+	double chi2 = 0;
+	pdf * p = m_pdflist.at(u);
 	dataset * ns = p->normset();
-	std::vector<std::vector<double *>> vvp(d->size());
-	for (size_t v = 0; v < ns->size(); ++v) {
-		double x = ns->at(v)[0];
-		int bin = d->find_bin(x);
+	datahist * d = dynamic_cast<datahist *>(m_datalist.at(u));
+
+	double nfit_tot = 0;
+	std::vector<double> nfit_vec(d->size(), 0);
+	std::vector<double> val;
+	const std::vector<std::vector<size_t>> & bins = m_data[u]->bins;
+	for (size_t v = 0; v < d->size(); ++v) {
+		PROFILE_ADD(events, bins[v].size());
+		val.resize(bins[v].size());
+		p->evaluate_indexed(ns, bins[v], val.data());
+		for (size_t w = 0; w < bins[v].size(); ++w) {
+			nfit_vec[v] += val[w];
+		}
+		nfit_tot += nfit_vec[v];
+	}
+
+	double nevt = d->nevt();
+	for (size_t v = 0; v < d->size(); ++v) {
+		double nobs = d->weight(v);
+		double err_u = d->err_up(v);
+		double err_d = d->err_down(v);
+		double nfit = nevt * nfit_vec[v] / nfit_tot;
+	
+		if (nfit > nobs && err_u) {
+			chi2 += pow(nfit-nobs, 2)/err_u/err_u;
+		}
+		else if (nfit < nobs && err_d) {
+			chi2 += pow(nfit-nobs, 2)/err_d/err_d;
+		}
+		else if (nfit) {
+			chi2 += pow(nfit-nobs, 2)/nfit;
+		}
+	}
+	return chi2;
+}
+
+// normset events are kept by index, so that they survive the arrays moving when events are appended; events
+// appended since the last call are binned into a new index, clones keep the one they were made with
+void chi2fcn::bin_events(size_t u) const
+{
+	dataset * ns = m_pdflist[u]->normset();
+	datahist * d = dynamic_cast<datahist *>(m_datalist[u]);
+	if (m_data[u] && m_data[u]->nbinned == ns->size()) return;
+	ns->wait();
+	size_t nread = ns->loaded(); // short of size() only after a failed load, the rest is not data
+	if (m_data[u] && m_data[u]->nbinned == nread) return;
+	std::shared_ptr<binindex> index(new binindex);
+	if (m_data[u]) *index = *m_data[u];
+	else *index = binindex{std::vector<std::vector<size_t>>(d->size()), 0};
+	for (size_t v = index->nbinned; v < nread; ++v) {
+		int bin = d->find_bin(ns->at(v));
 		if (bin >= 0 && bin < d->size()) {
-			vvp[bin].push_back(ns->at(v));
+			index->bins[bin].push_back(v);
 		}
 	}
-	m_data.push_back(std::move(vvp));
+	index->nbinned = nread;
+	m_data[u] = index;
+}
+
+void chi2fcn::update_data(pdf * p, datahist * d)
+{
+	m_data.push_back(std::shared_ptr<const binindex>());
+	bin_events(m_data.size()-1);
 }
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include "TMath.h"
 #include "fcn.h"
 
@@ -18,14 +19,25 @@ class chi2fcn: public fcn
 		
 		void add(pdf * p, datahist * d);
 		
+		virtual fcn * clone() const;
 		virtual double operator()(const std::vector<double> & par) const;
 		virtual double Up() const { return 1.0; }
 
 	protected:
+		// normset events in each bin of a channel, shared read-only by an fcn and its clones
+		struct binindex
+		{
+			std::vector<std::vector<size_t>> bins;
+			size_t nbinned; // normset events sorted into bins so far
+		};
+
+	protected:
+		void bin_events(size_t u) const;
+		double channel_chi2(size_t u) const;
 		void update_data(pdf * p, datahist * d);
 
 	protected:
-		mutable std::vector<std::vector<std::vector<double *>>> m_data;
+		mutable std::vector<std::shared_ptr<const binindex>> m_data; // one per channel, replaced (not changed) when the normset grows
 };
 
 #endif
@@ -0,0 +1,47 @@
+#include "context.h"
+
+context::context(context * parent):
+	m_parent(parent)
+{
+}
+
+context::~context()
+{
+	if (current() == this) deactivate();
+}
+
+void context::activate()
+{
+	previous().push_back(current());
+	set_current(this);
+}
+
+void context::deactivate()
+{
+	if (previous().empty()) {
+		set_current(0);
+		return;
+	}
+	set_current(previous().back());
+	previous().pop_back();
+}
+
+void context::set_err(size_t id, int n, double v)
+{
+	if (3*id+n >= m_err_set.size()) {
+		m_err_set.resize(3*id+3, 0);
+		m_err.resize(3*id+3, 0);
+	}
+	m_err_set[3*id+n] = 1;
+	m_err[3*id+n] = v;
+}
+
+void context::set_value(size_t id, double v)
+{
+	if (id >= m_set.size()) {
+		m_set.resize(id+1, 0);
+		m_value.resize(id+1, 0);
+	}
+	m_set[id] = 1;
+	m_value[id] = v;
+}
@@ -0,0 +1,88 @@
+#ifndef CONTEXT_H__
+#define CONTEXT_H__
+
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+// private copy of parameter values and of the caches that depend on them;
+// while a context is active on a thread, variables and pdfs read and write it instead of their own members,
+// values and caches that are not set in a context are taken from its parent (or from the variables and pdfs);
+// fits running in different contexts do not interfere, so independent fits can run on different threads
+class context
+{
+	public:
+		context(context * parent = 0);
+		context(const context & c) = delete;
+		context & operator=(const context & c) = delete;
+		virtual ~context();
+
+		void activate();
+		void deactivate();
+		double err(size_t id, int n, double v);
+		void set_err(size_t id, int n, double v);
+		void set_parent(context * parent) { m_parent = parent; }
+		void set_value(size_t id, double v);
+		double value(size_t id, double v);
+
+		template <typename T> T & state(const void * owner, const T & init);
+
+		static context * current() { return current_ref(); }
+		static void set_current(context * c) { current_ref() = c; }
+
+	private:
+		static context *& current_ref();
+		static std::vector<context *> & previous();
+
+	private:
+		context * m_parent;
+		std::vector<char> m_set;
+		std::vector<double> m_value;
+		std::vector<char> m_err_set;
+		std::vector<double> m_err;
+		std::shared_mutex m_mutex;
+		std::unordered_map<const void *, std::shared_ptr<void>> m_state;
+};
+
+// n = 0: symmetric error, 1: lower error, 2: upper error
+inline double context::err(size_t id, int n, double v)
+{
+	if (3*id+n < m_err_set.size() && m_err_set[3*id+n]) return m_err[3*id+n];
+	return m_parent ? m_parent->err(id, n, v) : v;
+}
+
+inline double context::value(size_t id, double v)
+{
+	if (id < m_set.size() && m_set[id]) return m_value[id];
+	return m_parent ? m_parent->value(id, v) : v;
+}
+
+// per-context copy of a cache owned by 'owner', initialized from the parent's copy (or 'init') at first use;
+// the first use may happen on several pool workers at once, only one copy is kept then
+template <typename T> T & context::state(const void * owner, const T & init)
+{
+	{
+		std::shared_lock<std::shared_mutex> lock(m_mutex);
+		auto it = m_state.find(owner);
+		if (it != m_state.end()) return *static_cast<T *>(it->second.get());
+	}
+	std::shared_ptr<void> p = std::make_shared<T>(m_parent ? m_parent->state(owner, init) : init);
+	std::unique_lock<std::shared_mutex> lock(m_mutex);
+	return *static_cast<T *>(m_state.emplace(owner, p).first->second.get());
+}
+
+inline context *& context::current_ref()
+{
+	static thread_local context * c = 0;
+	return c;
+}
+
+// contexts replaced by activate, kept per thread so that one context can be active on several threads at once
+inline std::vector<context *> & context::previous()
+{
+	static thread_local std::vector<context *> s;
+	return s;
+}
+
+#endif
@@ -1,12 +1,14 @@
 #include <iostream>
 #include "datahist.h"
+#include "pdf.h"
 
 datahist::datahist(TH1 * h):
-	dataset(h->GetNbinsX(), 1),
+	dataset(h->GetNbinsX()*((h->GetDimension() > 1) ? h->GetNbinsY() : 1), (h->GetDimension() > 1) ? 2 : 1),
 	m_hist(h)
 {
 	acquire_resourse();
-	if (!init_from_h1d(h)) release_resourse();
+	bool ok = (m_dim == 1) ? init_from_h1d(h) : init_from_h2d(h);
+	if (!ok) release_resourse();
 }
 
 datahist::~datahist()
@@ -56,6 +58,17 @@ void datahist::draw(TH1 * h, std::function<double(double *)> weight_func, const
 	h->Draw(option);
 }
 
+int datahist::find_bin(const double * x)
+{
+	if (m_dim == 1) return find_bin(x[0]);
+
+	int nx = m_hist->GetNbinsX();
+	int bx = m_hist->GetXaxis()->FindFixBin(x[0]);
+	int by = m_hist->GetYaxis()->FindFixBin(x[1]);
+	if (bx < 1 || bx > nx || by < 1 || by > m_hist->GetNbinsY()) return -1;
+	return (bx-1) + nx*(by-1);
+}
+
 bool datahist::init_from_h1d(TH1 * h)
 {
 	m_wsize = 0;
@@ -72,6 +85,29 @@ bool datahist::init_from_h1d(TH1 * h)
 	return true;
 }
 
+// bins are flattened with x running fastest, edges are kept for the x axis only
+bool datahist::init_from_h2d(TH1 * h)
+{
+	m_wsize = 0;
+	int nx = h->GetNbinsX();
+	for (size_t u = 0; u < m_size; ++u) {
+		int bx = u%nx + 1;
+		int by = u/nx + 1;
+		int bin = h->GetBin(bx, by);
+		m_arr[2*u] = h->GetXaxis()->GetBinCenter(bx);
+		m_arr[2*u+1] = h->GetYaxis()->GetBinCenter(by);
+		m_weight[u] = h->GetBinContent(bin);
+		m_err[u] = h->GetBinError(bin);
+		m_err_down[u] = h->GetBinErrorLow(bin);
+		m_err_up[u] = h->GetBinErrorUp(bin);
+		m_wsize += m_weight[u];
+	}
+	for (int u = 0; u <= nx; ++u) {
+		m_edge[u] = h->GetXaxis()->GetBinLowEdge(u+1);
+	}
+	return true;
+}
+
 double datahist::max(int n)
 {
 	return m_edge[0];
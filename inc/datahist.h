@@ -22,6 +22,7 @@ class datahist: public dataset
 		double err_down(int n) { return m_err_down[n]; }
 		double err_up(int n) { return m_err_up[n]; }
 		int find_bin(double x) { return m_hist->FindBin(x)-1; }
+		int find_bin(const double * x);
 		double max(int n = 0);
 		double min(int n = 0);
 		void set_binning(int n, double lo, double hi) = delete;
@@ -32,6 +33,7 @@ class datahist: public dataset
 	private:
 		void acquire_resourse();
 		bool init_from_h1d(TH1 * h1);
+		bool init_from_h2d(TH1 * h2);
 		void release_resourse();
 	
 	protected:
@@ -1,18 +1,36 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include "TLeaf.h"
+#include "TMath.h"
+#include "TROOT.h"
 #include "dataset.h"
+#include "numa.h"
+#include "parallel.h"
 #include "pdf.h"
+#include "profiler.h"
+#include "projection.h"
+#include "tracer.h"
 
 dataset::dataset(size_t s, size_t d):
 	m_size(s),
-	m_dim(d)
+	m_dim(d),
+	m_wsize(0),
+	m_flat(false),
+	m_loaded(s),
+	m_failed(false)
 {
 	acquire_resourse();
 }
 
 dataset::dataset(TTree * t, const std::vector<const char *> & varname):
 	m_size(t->GetEntries()),
-	m_dim(varname.size())
+	m_dim(varname.size()),
+	m_wsize(0),
+	m_flat(false),
+	m_loaded(0),
+	m_failed(false)
 {
 	acquire_resourse();
 	if (!init_from_tree(t, varname)) release_resourse();
@@ -20,7 +38,11 @@ dataset::dataset(TTree * t, const std::vector<const char *> & varname):
 
 dataset::dataset(TTree * t, const std::vector<const char *> & varname, const char * wname):
 	m_size(t->GetEntries()),
-	m_dim(varname.size())
+	m_dim(varname.size()),
+	m_wsize(0),
+	m_flat(false),
+	m_loaded(0),
+	m_failed(false)
 {
 	acquire_resourse();
 	if (!init_from_tree(t, varname, wname)) release_resourse();
@@ -28,39 +50,182 @@ dataset::dataset(TTree * t, const std::vector<const char *> & varname, const cha
 
 dataset::~dataset()
 {
+	if (m_loader.joinable()) m_loader.join();
 	release_resourse();
 }
 
+// the arrays are zero-filled on the thread pool: pages are placed on the node of the thread that touches them
+// first, with a NUMA-aware pool this is the worker whose share of every later pass covers these events
 void dataset::acquire_resourse()
 {
+	m_capacity = m_size;
 	m_arr = new double[m_size*m_dim];
-	for (size_t u = 0; u < m_size*m_dim; ++u) {
-		m_arr[u] = 0;
-	}
-	
 	m_weight = new double[m_size];
-	for (size_t u = 0; u < m_size; ++u) {
-		m_weight[u] = 0;
+	parallel::for_each(m_size, [&](size_t begin, size_t end) {
+		std::fill(m_arr+begin*m_dim, m_arr+end*m_dim, 0.0);
+		std::fill(m_weight+begin, m_weight+end, 0.0);
+	}, 4096);
+}
+
+// adds an event at the end and returns its index; the arrays grow by doubling, so that appending costs O(1)
+// amortized. The arrays may move, the dataset must not be read while events are appended; condensations made
+// before are not updated
+size_t dataset::append(const double * x, double w)
+{
+	if (!wait()) {
+		std::cout << "[dataset] error: cannot append to a dataset whose load failed" << std::endl;
+		return size_t(-1);
 	}
+	if (m_size == m_capacity) reserve(std::max<size_t>(2*m_capacity, 1024));
+	std::copy(x, x+m_dim, m_arr+m_size*m_dim);
+	m_weight[m_size] = w;
+	m_wsize += w;
+	m_flat = false;
+	set_loaded(++m_size);
+	std::lock_guard<std::mutex> lock(m_condensed_mutex);
+	m_condensed.clear();
+	return m_size-1;
 }
 
-void dataset::draw(TH1 * h, const char * option, size_t x, pdf * p)
+// all events of d (in its first dim() dimensions) at the end
+void dataset::append(dataset & d)
 {
-	if (x < m_dim) {
-		h->Reset();
-		double * curr = m_arr;
-		if (p && p->dim() <= m_dim) {
-			for (size_t u = 0; u < m_size; ++u) {
-				h->Fill(curr[x], m_weight[u]*p->operator()(curr));
-				curr += m_dim;
+	if (d.dim() < m_dim) {
+		std::cout << "[dataset] error: cannot append events with fewer than " << m_dim << " dimensions" << std::endl;
+		return;
+	}
+	if (!wait()) {
+		std::cout << "[dataset] error: cannot append to a dataset whose load failed" << std::endl;
+		return;
+	}
+	d.wait();
+	size_t n = d.loaded();
+	if (m_size+n > m_capacity) reserve(std::max(m_size+n, 2*m_capacity));
+	if (d.dim() == m_dim) {
+		std::copy(d.at(0), d.at(0)+n*m_dim, m_arr+m_size*m_dim);
+	}
+	else {
+		for (size_t u = 0; u < n; ++u) {
+			std::copy(d.at(u), d.at(u)+m_dim, m_arr+(m_size+u)*m_dim);
+		}
+	}
+	std::copy(d.m_weight, d.m_weight+n, m_weight+m_size);
+	for (size_t u = 0; u < n; ++u) {
+		m_wsize += m_weight[m_size+u];
+	}
+	m_flat = false;
+	m_size += n;
+	set_loaded(m_size);
+	std::lock_guard<std::mutex> lock(m_condensed_mutex);
+	m_condensed.clear();
+}
+
+// the first dim dimensions binned into nbin cells each (over the range of the events), one event per non-empty
+// cell with the sum of the weights at their weighted mean position (or the centre of the cell); condensations are
+// shared while someone holds them
+std::shared_ptr<dataset> dataset::condense(size_t dim, size_t nbin, bool mean)
+{
+	dim = std::min(dim, m_dim);
+	wait();
+	size_t nread = loaded(); // all events, or those read before a failed load
+	std::lock_guard<std::mutex> lock(m_condensed_mutex);
+	std::weak_ptr<dataset> & cached = m_condensed[std::make_tuple(dim, nbin, mean)];
+	std::shared_ptr<dataset> c = cached.lock();
+	if (c) return c;
+
+	tracer::span span("condense", "data", "events", nread);
+	PROFILE_SCOPE(this, "condense");
+	PROFILE_ADD(events, nread);
+	std::vector<double> lo(dim), step(dim);
+	for (size_t d = 0; d < dim; ++d) {
+		lo[d] = min(d);
+		step[d] = (max(d)-lo[d])/nbin;
+		if (step[d] <= 0) step[d] = 1;
+	}
+	std::vector<std::pair<size_t, size_t>> cell(nread);
+	parallel::for_each(nread, [&](size_t begin, size_t end) {
+		for (size_t u = begin; u < end; ++u) {
+			size_t k = 0;
+			for (size_t d = dim; d-- > 0;) {
+				size_t b = std::min(nbin-1, size_t((m_arr[u*m_dim+d]-lo[d])/step[d]));
+				k = k*nbin + b;
 			}
+			cell[u] = std::make_pair(k, u);
 		}
-		else {
-			for (size_t u = 0; u < m_size; ++u) {
-				h->Fill(curr[x], m_weight[u]);
-				curr += m_dim;
+	}, 4096);
+	std::sort(cell.begin(), cell.end());
+
+	std::vector<size_t> first;
+	for (size_t u = 0; u < nread; ++u) {
+		if (!u || cell[u].first != cell[u-1].first) first.push_back(u);
+	}
+	first.push_back(nread);
+	c.reset(new dataset(first.size()-1, dim));
+	for (size_t k = 0; k+1 < first.size(); ++k) {
+		double w = 0;
+		std::vector<double> wx(dim, 0);
+		for (size_t v = first[k]; v < first[k+1]; ++v) {
+			size_t u = cell[v].second;
+			w += m_weight[u];
+			for (size_t d = 0; d < dim; ++d) {
+				wx[d] += m_weight[u]*m_arr[u*m_dim+d];
 			}
 		}
+		size_t id = cell[first[k]].first;
+		for (size_t d = 0; d < dim; ++d) {
+			double centre = lo[d] + (id%nbin + 0.5)*step[d];
+			c->set_val(k, d, (mean && w > 0) ? wx[d]/w : centre);
+			id /= nbin;
+		}
+		c->set_weight(k, w);
+	}
+	cached = c;
+	return c;
+}
+
+// declares the dataset flat if the weights are equal and every dimension is compatible with a uniform
+// distribution (Kolmogorov test, probability above pmin); the box is estimated from the range of the events.
+// Only the marginals are tested, a multi-dimensional acceptance that keeps them uniform is better declared
+// with set_flat
+bool dataset::detect_flat(double pmin)
+{
+	wait();
+	size_t nread = loaded();
+	if (nread < 2) return false;
+	for (size_t u = 1; u < nread; ++u) {
+		if (m_weight[u] != m_weight[0]) return false;
+	}
+
+	std::vector<double> lo(m_dim), hi(m_dim);
+	std::vector<double> x(nread);
+	for (size_t d = 0; d < m_dim; ++d) {
+		for (size_t u = 0; u < nread; ++u) {
+			x[u] = m_arr[u*m_dim+d];
+		}
+		std::sort(x.begin(), x.end());
+		// unbiased estimate of the edges of a uniform distribution from the smallest and largest event
+		double margin = (x.back()-x.front())/(nread-1);
+		lo[d] = x.front()-margin;
+		hi[d] = x.back()+margin;
+		if (lo[d] >= hi[d]) return false;
+
+		double dmax = 0;
+		for (size_t u = 0; u < nread; ++u) {
+			double f = (x[u]-lo[d])/(hi[d]-lo[d]);
+			dmax = std::max(dmax, std::max(fabs(f-double(u)/nread), fabs(f-double(u+1)/nread)));
+		}
+		if (TMath::KolmogorovProb(dmax*sqrt(double(nread))) < pmin) return false;
+	}
+	return set_flat(lo, hi);
+}
+
+// the histogram is filled by a projection, in parallel and with the pdf evaluated in batches
+void dataset::draw(TH1 * h, const char * option, size_t x, pdf * p)
+{
+	if (x < m_dim) {
+		projection proj(this);
+		proj.add(h, x, (p && p->dim() <= m_dim) ? p : 0);
+		proj.fill();
 		h->Draw(option);
 	}
 	else {
@@ -71,12 +236,9 @@ void dataset::draw(TH1 * h, const char * option, size_t x, pdf * p)
 void dataset::draw(TH1 * h, std::function<double(double *)> weight_func, const char * option, size_t x)
 {
 	if (x < m_dim) {
-		h->Reset();
-		double * curr = m_arr;
-		for (size_t u = 0; u < m_size; ++u) {
-			h->Fill(curr[x], m_weight[u]*weight_func(curr));
-			curr += m_dim;
-		}
+		projection proj(this);
+		proj.add(h, weight_func, x);
+		proj.fill();
 		h->Draw(option);
 	}
 	else {
@@ -87,20 +249,9 @@ void dataset::draw(TH1 * h, std::function<double(double *)> weight_func, const c
 void dataset::draw(TH2 * h, const char * option, size_t x, size_t y, pdf * p)
 {
 	if (x < m_dim && y < m_dim) {
-		h->Reset();
-		double * curr = m_arr;
-		if (p && p->dim() <= m_dim) {
-			for (size_t u = 0; u < m_size; ++u) {
-				h->Fill(curr[x], curr[y], m_weight[u]*p->operator()(curr));
-				curr += m_dim;
-			}
-		}
-		else {
-			for (size_t u = 0; u < m_size; ++u) {
-				h->Fill(curr[x], curr[y], m_weight[u]);
-				curr += m_dim;
-			}
-		}
+		projection proj(this);
+		proj.add(h, x, y, (p && p->dim() <= m_dim) ? p : 0);
+		proj.fill();
 		h->Draw(option);
 	}
 	else {
@@ -110,13 +261,10 @@ void dataset::draw(TH2 * h, const char * option, size_t x, size_t y, pdf * p)
 
 void dataset::draw(TH2 * h, std::function<double(double *)> weight_func, const char * option, size_t x, size_t y)
 {
-	if (x < m_dim) {
-		h->Reset();
-		double * curr = m_arr;
-		for (size_t u = 0; u < m_size; ++u) {
-			h->Fill(curr[x], curr[y], m_weight[u]*weight_func(curr));
-			curr += m_dim;
-		}
+	if (x < m_dim && y < m_dim) {
+		projection proj(this);
+		proj.add(h, weight_func, x, y);
+		proj.fill();
 		h->Draw(option);
 	}
 	else {
@@ -124,81 +272,87 @@ void dataset::draw(TH2 * h, std::function<double(double *)> weight_func, const c
 	}
 }
 
-bool dataset::init_from_tree(TTree * t, const std::vector<const char *> & varname)
+// one lock per file, trees of the same file are not read at once
+std::mutex & dataset::file_mutex(TFile * f)
 {
-	std::map<std::string, double> dmap;
-	std::map<std::string, float> fmap;
-	for (size_t u = 0; u < m_dim; ++u) {
-		auto * leaf = t->FindLeaf(varname[u]);
-		if (leaf) {
-			if (!strcmp(leaf->GetTypeName(), "Double_t")) {
-				t->SetBranchAddress(varname[u], &dmap[varname[u]]);
-			}
-			else if (!strcmp(leaf->GetTypeName(), "Float_t")) {
-				t->SetBranchAddress(varname[u], &fmap[varname[u]]);
-			}
-			else return false;
-		}
-		else return false;
+	std::lock_guard<std::mutex> lock(file_pool_mutex);
+	return file_pool[f];
+}
+
+// volume of the flat box in its first d dimensions
+double dataset::flat_volume(size_t d)
+{
+	double v = 1;
+	for (size_t u = 0; u < d && u < m_flat_lo.size(); ++u) {
+		v *= m_flat_hi[u]-m_flat_lo[u];
 	}
+	return v;
+}
 
-	m_wsize = 0;
-	double * curr = m_arr;
-	for (size_t u = 0; u < m_size; ++u) {
-		t->GetEntry(u);
-		for (size_t v = 0; v < m_dim; ++v) {
-			if (dmap.find(varname[v]) != dmap.end()) {
-				*curr = dmap[varname[v]];
-				++curr;
-			}
-			else {
-				*curr = fmap[varname[v]];
-				++curr;
-			}
-		}
-		m_weight[u] = 1;
-		m_wsize += 1;
+bool dataset::init_from_tree(TTree * t, const std::vector<const char *> & varname)
+{
+	for (const char * name: varname) {
+		if (!leaf_type(t, name)) return false;
 	}
-	return true;
+	return read_tree(t, std::vector<std::string>(varname.begin(), varname.end()), false);
 }
 
 bool dataset::init_from_tree(TTree * t, const std::vector<const char *> & varname, const char * wname)
 {
-	if (init_from_tree(t, varname)) {
-		m_wsize = 0;
-		double wd;
-		float wf;
-		auto * leaf = t->FindLeaf(wname);
-		if (leaf) {
-			if (!strcmp(leaf->GetTypeName(), "Double_t")) {
-				t->SetBranchAddress(wname, &wd);
-				for (size_t u = 0; u < m_size; ++u) {
-					t->GetEntry(u);
-					m_weight[u] = wd; 
-					m_wsize += wd;
-				}
-			}
-			else if (!strcmp(leaf->GetTypeName(), "Float_t")) {
-				t->SetBranchAddress(wname, &wf);
-				for (size_t u = 0; u < m_size; ++u) {
-					t->GetEntry(u);
-					m_weight[u] = wf; 
-					m_wsize += wf;
-				}
-			}
-			else return false;
-		}
-		else return false;
+	std::vector<std::string> name(varname.begin(), varname.end());
+	name.push_back(wname);
+	for (const std::string & n: name) {
+		if (!leaf_type(t, n.c_str())) return false;
 	}
-	return true;
+	return read_tree(t, name, true);
 }
 
+// 'd' for a Double_t leaf, 'f' for a Float_t one, 0 if there is no such leaf or it has another type
+char dataset::leaf_type(TTree * t, const char * name)
+{
+	TLeaf * leaf = t->FindLeaf(name);
+	if (!leaf) return 0;
+	if (!strcmp(leaf->GetTypeName(), "Double_t")) return 'd';
+	if (!strcmp(leaf->GetTypeName(), "Float_t")) return 'f';
+	return 0;
+}
+
+// dataset of the entries of the tree, returned at once and filled on a thread of its own: events [0, loaded())
+// can be read while the rest is on its way, everything that reads a dataset waits for the events it needs
+// (nevt for all of them). The tree must not be used until the dataset is loaded; trees of the same file are
+// read one after the other. Returns null if a branch is missing or is neither Double_t nor Float_t
+std::shared_ptr<dataset> dataset::load(TTree * t, const std::vector<const char *> & varname, const char * wname)
+{
+	std::vector<std::string> name(varname.begin(), varname.end());
+	if (wname) name.push_back(wname);
+	for (const std::string & n: name) {
+		if (!leaf_type(t, n.c_str())) {
+			std::cout << "[dataset] error: branch " << n << " not found or not Double_t/Float_t" << std::endl;
+			return std::shared_ptr<dataset>();
+		}
+	}
+
+	ROOT::EnableThreadSafety();
+	std::shared_ptr<dataset> d(new dataset(t->GetEntries(), varname.size()));
+	d->m_loaded.store(0);
+	dataset * p = d.get();
+	bool weighted = (wname != 0);
+	d->m_loader = std::thread([p, t, name, weighted]() {
+		std::lock_guard<std::mutex> lock(file_mutex(t->GetCurrentFile()));
+		if (!p->read_tree(t, name, weighted)) {
+			std::cout << "[dataset] error: failed to read the tree, only the first " << p->loaded() << " events are filled" << std::endl;
+		}
+	});
+	return d;
+}
 double dataset::max(int n)
 {
-	if (!m_size || n >= m_dim) return 0;
+	wait();
+	size_t nread = loaded();
+	if (!nread || n >= m_dim) return 0;
 	
 	double m = m_arr[n];
-	for (size_t u = 1; u < m_size; ++u) {
+	for (size_t u = 1; u < nread; ++u) {
 		if (m < m_arr[u*m_dim+n]) m = m_arr[u*m_dim+n];
 	}
 	return m;
@@ -206,17 +360,172 @@ double dataset::max(int n)
 
 double dataset::min(int n)
 {
-	if (!m_size || n >= m_dim) return 0;
+	wait();
+	size_t nread = loaded();
+	if (!nread || n >= m_dim) return 0;
 	
 	double m = m_arr[n];
-	for (size_t u = 1; u < m_size; ++u) {
+	for (size_t u = 1; u < nread; ++u) {
 		if (m > m_arr[u*m_dim+n]) m = m_arr[u*m_dim+n];
 	}
 	return m;
 }
 
+// for each share of the thread pool: its events, the node of the worker that owns it and the nodes the pages
+// of its events are on
+void dataset::print_placement(std::ostream & os)
+{
+	size_t nshare = parallel::nthread();
+	os << "dataset: " << m_size << " events, " << numa::nnode() << " NUMA node(s), pool ";
+	os << (parallel::numa_aware() ? "NUMA-aware" : "not NUMA-aware") << std::endl;
+	for (size_t k = 0; k < nshare; ++k) {
+		size_t begin = k*m_size/nshare;
+		size_t end = (k+1)*m_size/nshare;
+		std::map<int, size_t> npage;
+		for (int n: numa::nodes_of(m_arr+begin*m_dim, (end-begin)*m_dim*sizeof(double))) {
+			++npage[n];
+		}
+		os << "  events " << std::setw(10) << begin << " - " << std::setw(10) << end;
+		int node = parallel::worker_node(k+1);
+		os << "  worker " << std::setw(3) << k+1 << " (node " << (node < 0 ? std::string("-") : std::to_string(node)) << ")  pages:";
+		for (const std::pair<const int, size_t> & p: npage) {
+			os << " node " << (p.first < 0 ? std::string("?") : std::to_string(p.first)) << " " << p.second;
+		}
+		os << std::endl;
+	}
+}
+
+// the observables and (if weighted) the weight, last in name, in one pass over the entries; loaded is advanced
+// every load_size events so that readers can start on the events already filled
+bool dataset::read_tree(TTree * t, const std::vector<std::string> & name, bool weighted)
+{
+	tracer::span span("init_from_tree", "data", "events", m_size);
+	PROFILE_SCOPE(this, "init_from_tree");
+	PROFILE_ADD(events, m_size);
+	PROFILE_ADD(bytes, m_size*(m_dim+1)*sizeof(double));
+	std::vector<double> dval(name.size());
+	std::vector<float> fval(name.size());
+	std::vector<char> type(name.size());
+	for (size_t v = 0; v < name.size(); ++v) {
+		type[v] = leaf_type(t, name[v].c_str());
+		if (type[v] == 'd') t->SetBranchAddress(name[v].c_str(), &dval[v]);
+		else if (type[v] == 'f') t->SetBranchAddress(name[v].c_str(), &fval[v]);
+		else {
+			t->ResetBranchAddresses();
+			stop_loading(0);
+			return false;
+		}
+	}
+
+	double wsize = 0;
+	for (size_t b = 0; b < m_size; b += load_size) {
+		size_t e = std::min(b+load_size, m_size);
+		for (size_t u = b; u < e; ++u) {
+			if (t->GetEntry(u) <= 0) {
+				t->ResetBranchAddresses();
+				m_wsize = wsize;
+				stop_loading(u);
+				return false;
+			}
+			for (size_t v = 0; v < name.size(); ++v) {
+				double x = (type[v] == 'd') ? dval[v] : fval[v];
+				if (v < m_dim) m_arr[u*m_dim+v] = x;
+				else m_weight[u] = x;
+			}
+			if (!weighted) m_weight[u] = 1;
+			wsize += m_weight[u];
+		}
+		if (e == m_size) m_wsize = wsize;
+		set_loaded(e);
+	}
+	// the branches pointed to this frame
+	t->ResetBranchAddresses();
+	return true;
+}
+
 void dataset::release_resourse()
 {
 	if (m_arr) delete[] m_arr;
 	if (m_weight) delete [] m_weight;
+	m_arr = 0;
+	m_weight = 0;
+	m_size = 0;
+	m_capacity = 0;
+	m_loaded.store(0);
 }
+
+// room for n events, the events are copied on the thread pool so that their pages are placed as in
+// acquire_resourse
+void dataset::reserve(size_t n)
+{
+	wait();
+	if (n <= m_capacity) return;
+	double * arr = new double[n*m_dim];
+	double * weight = new double[n];
+	parallel::for_each(m_size, [&](size_t begin, size_t end) {
+		std::copy(m_arr+begin*m_dim, m_arr+end*m_dim, arr+begin*m_dim);
+		std::copy(m_weight+begin, m_weight+end, weight+begin);
+	}, 4096);
+	delete[] m_arr;
+	delete[] m_weight;
+	m_arr = arr;
+	m_weight = weight;
+	m_capacity = n;
+}
+
+// declares that the events are distributed uniformly in the box [lo, hi] with equal weights, pdfs with a
+// closed-form integral are then normalized without summing over the events
+bool dataset::set_flat(const std::vector<double> & lo, const std::vector<double> & hi)
+{
+	wait();
+	m_flat = false;
+	if (lo.size() != m_dim || hi.size() != m_dim) {
+		std::cout << "[dataset] error: flat box needs a range in each of the " << m_dim << " dimensions" << std::endl;
+		return false;
+	}
+	for (size_t u = 0; u < m_size; ++u) {
+		if (m_weight[u] != m_weight[0]) {
+			std::cout << "[dataset] error: flat dataset needs equal weights" << std::endl;
+			return false;
+		}
+		for (size_t d = 0; d < m_dim; ++d) {
+			double x = m_arr[u*m_dim+d];
+			if (!(lo[d] < hi[d]) || x < lo[d] || x > hi[d]) {
+				std::cout << "[dataset] error: event " << u << " is outside the flat box" << std::endl;
+				return false;
+			}
+		}
+	}
+	m_flat_lo = lo;
+	m_flat_hi = hi;
+	m_flat = true;
+	return true;
+}
+
+void dataset::set_loaded(size_t n)
+{
+	std::lock_guard<std::mutex> lock(m_load_mutex);
+	m_loaded.store(n, std::memory_order_release);
+	m_load_cv.notify_all();
+}
+
+// a read that failed after n events: the size stays (readers may hold it), the events not read keep zero
+// weight, and everyone waiting for more is released with failed() set
+void dataset::stop_loading(size_t n)
+{
+	std::lock_guard<std::mutex> lock(m_load_mutex);
+	m_loaded.store(n, std::memory_order_release);
+	m_failed.store(true, std::memory_order_release);
+	m_load_cv.notify_all();
+}
+
+bool dataset::wait_loaded(size_t n)
+{
+	std::unique_lock<std::mutex> lock(m_load_mutex);
+	m_load_cv.wait(lock, [&]() { return loaded() >= std::min(n, m_size) || failed(); });
+	return loaded() >= std::min(n, m_size);
+}
+
+size_t dataset::load_size = 65536;
+std::mutex dataset::file_pool_mutex;
+std::map<TFile *, std::mutex> dataset::file_pool;
@@ -1,7 +1,18 @@
 #ifndef DATASET_H__
 #define DATASET_H__
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
+#include "TFile.h"
 #include "TH1.h"
 #include "TH2.h"
 #include "TTree.h"
@@ -18,33 +29,73 @@ class dataset
 		dataset & operator=(const dataset & d) = delete;
 		virtual ~dataset();
 		
+		size_t append(const double * x, double w = 1);
+		void append(dataset & d);
 		double * at(size_t n) { return m_arr+n*m_dim; }
+		size_t capacity() { return m_capacity; }
+		std::shared_ptr<dataset> condense(size_t dim, size_t nbin, bool mean = true);
+		bool detect_flat(double pmin = 0.01);
 		size_t dim() { return m_dim; }
 		void draw(TH1 * h, const char * option = "e", size_t x = 0, pdf * p = 0);
 		void draw(TH1 * h, std::function<double(double *)> weight_func, const char * option = "e", size_t x = 0);
 		void draw(TH2 * h, const char * option = "e", size_t x = 0, size_t y = 1, pdf * p = 0);
 		void draw(TH2 * h, std::function<double(double *)> weight_func, const char * option = "e", size_t x = 0, size_t y = 1);
-		double nevt() { return m_wsize; }
-		void set_val(size_t n, size_t d, double v) { m_arr[n*m_size+d] = v; }
-		void set_weight(size_t n, double w) { m_weight[n] = w; }
+		bool flat() { return m_flat; }
+		const std::vector<double> & flat_hi() { return m_flat_hi; }
+		const std::vector<double> & flat_lo() { return m_flat_lo; }
+		double flat_volume(size_t d);
+		bool failed() { return m_failed.load(std::memory_order_acquire); } // the load stopped at an error, see load
+		size_t loaded() { return m_loaded.load(std::memory_order_acquire); }
+		double nevt() { wait(); return m_wsize; }
+		void print_placement(std::ostream & os = std::cout);
+		void reserve(size_t n);
+		bool set_flat(const std::vector<double> & lo, const std::vector<double> & hi);
+		void set_val(size_t n, size_t d, double v) { m_arr[n*m_dim+d] = v; m_flat = false; }
+		void set_weight(size_t n, double w) { m_wsize += w-m_weight[n]; m_weight[n] = w; m_flat = false; }
 		size_t size() { return m_size; }
+		bool wait(size_t n = size_t(-1)) { return loaded() >= std::min(n, m_size) || wait_loaded(n); } // false if the events never come
 		double weight(size_t n) { return m_weight[n]; }
 		
 		virtual double max(int n = 0);
 		virtual double min(int n = 0);
 
+		static std::shared_ptr<dataset> load(TTree * t, const std::vector<const char *> & varname, const char * wname = 0);
+
+		static size_t load_size; // events read between two updates of loaded
+
 	private:
 		void acquire_resourse();
 		bool init_from_tree(TTree * t, const std::vector<const char *> & varname);
 		bool init_from_tree(TTree * t, const std::vector<const char *> & varname, const char * wname);
+		bool read_tree(TTree * t, const std::vector<std::string> & name, bool weighted);
 		void release_resourse();
+		void set_loaded(size_t n);
+		void stop_loading(size_t n);
+		bool wait_loaded(size_t n);
+
+		static char leaf_type(TTree * t, const char * name);
+		static std::mutex & file_mutex(TFile * f);
 	
 	protected:
 		size_t m_dim;
 		size_t m_size;
+		size_t m_capacity; // events the arrays have room for, see append
 		double m_wsize;
 		double * m_arr;
 		double * m_weight;
+		bool m_flat; // events uniform in the box [m_flat_lo, m_flat_hi] with equal weights
+		std::vector<double> m_flat_lo;
+		std::vector<double> m_flat_hi;
+		std::mutex m_condensed_mutex;
+		std::map<std::tuple<size_t, size_t, bool>, std::weak_ptr<dataset>> m_condensed; // see condense
+		std::atomic<size_t> m_loaded; // events [0, m_loaded) are filled, see load
+		std::atomic<bool> m_failed;
+		std::mutex m_load_mutex;
+		std::condition_variable m_load_cv;
+		std::thread m_loader;
+
+		static std::mutex file_pool_mutex;
+		static std::map<TFile *, std::mutex> file_pool;
 };
 
 #endif
@@ -1,17 +1,49 @@
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include "Minuit2/MnContours.h"
+#include "Minuit2/MnHesse.h"
 #include "Minuit2/MnPrint.h"
+#include "Minuit2/MnUserCovariance.h"
+#include "Minuit2/MnUserParameterState.h"
 #include "Minuit2/MnUserParameters.h"
+#include "TMatrixDSym.h"
+#include "context.h"
 #include "datahist.h"
 #include "dataset.h"
 #include "fcn.h"
+#include "gradfcn.h"
+#include "parallel.h"
 #include "pdf.h"
+#include "tracer.h"
 #include "variable.h"
 
+// events read by one evaluation of a channel, the first estimate of its cost
+static double channel_size(pdf * p, dataset * d)
+{
+	return (d ? d->size() : 0) + (p && p->normset() ? p->normset()->size() : 0);
+}
+
+fcn::fcn():
+	m_parallel_deriv(false),
+	m_verbose(true),
+	m_stat(new callstat)
+{
+	m_stat->ncall = 0;
+}
+
 fcn::fcn(pdf * p, dataset * d):
+	m_parallel_deriv(false),
+	m_verbose(true),
+	m_stat(new callstat),
 	m_pdflist({p}),
 	m_datalist({d})
 {
+	m_stat->ncall = 0;
+	m_stat->neval.push_back(0);
+	m_cost.push_back(channel_size(p, d));
 	update_varlist(p, d);
 }
 
@@ -23,38 +55,300 @@ void fcn::add(pdf * p, dataset * d)
 {
 	m_pdflist.push_back(p);
 	m_datalist.push_back(d);
+	m_stat->neval.push_back(0);
+	m_cost.push_back(channel_size(p, d));
 	update_varlist(p, d);
 }
 
-void fcn::minimize(bool minos_err)
+std::vector<std::pair<double, double>> fcn::contour(variable * x, variable * y, size_t npoint)
+{
+	return contours({std::make_pair(x, y)}, npoint)[0];
+}
+
+// each contour is traced by a clone of this fcn running in its own context on a worker thread
+std::vector<std::vector<std::pair<double, double>>> fcn::contours(const std::vector<std::pair<variable *, variable *>> & vpairs, size_t npoint)
+{
+	std::vector<std::vector<std::pair<double, double>>> result(vpairs.size());
+	if (!m_min) {
+		std::cout << "[fcn] error: contours need a minimum, call minimize first" << std::endl;
+		return result;
+	}
+
+	std::vector<std::pair<int, int>> index;
+	for (auto & vp: vpairs) {
+		int ix = std::find(m_varlist.begin(), m_varlist.end(), vp.first) - m_varlist.begin();
+		int iy = std::find(m_varlist.begin(), m_varlist.end(), vp.second) - m_varlist.begin();
+		if (ix == m_varlist.size() || iy == m_varlist.size()) {
+			std::cout << "[fcn] error: contour of [" << vp.first->name() << ", " << vp.second->name() << "] needs two floating parameters" << std::endl;
+			ix = iy = -1;
+		}
+		index.push_back(std::make_pair(ix, iy));
+	}
+
+	parallel::for_each(vpairs.size(), [&](size_t begin, size_t end) {
+		context ctx(context::current());
+		ctx.activate();
+		std::unique_ptr<fcn> f(clone());
+		ROOT::Minuit2::MnContours mncont(*f, *m_min);
+		for (size_t u = begin; u < end; ++u) {
+			if (index[u].first >= 0) result[u] = mncont(index[u].first, index[u].second, npoint);
+		}
+		ctx.deactivate();
+	});
+	return result;
+}
+
+void fcn::count_call(size_t n) const
+{
+	std::lock_guard<std::mutex> lock(m_stat->mutex);
+	m_stat->ncall += n;
+}
+
+void fcn::count_eval(size_t channel, size_t n) const
+{
+	std::lock_guard<std::mutex> lock(m_stat->mutex);
+	m_stat->neval[channel] += n;
+}
+
+double fcn::covariance(int u, int v)
+{
+	size_t n = m_varlist.size();
+	if (m_cov.size() == n*n) return m_cov[u*n+v];
+	if (m_min && m_min->UserState().HasCovariance()) return m_min->UserState().Covariance()(u, v);
+	return 0;
+}
+
+double fcn::min_fval()
+{
+	if (m_min && m_min->IsValid()) return m_min->Fval();
+	return std::nan("");
+}
+
+std::vector<double> fcn::min_pars()
+{
+	std::vector<double> par;
+	if (!m_min) return par;
+	for (variable * v: m_varlist) {
+		par.push_back(m_min->UserState().Value(v->name()));
+	}
+	return par;
+}
+
+// values at several parameter points, derived classes may evaluate all points in one pass over the data
+std::vector<double> fcn::evaluate(const std::vector<std::vector<double>> & points) const
+{
+	std::vector<double> val;
+	for (const std::vector<double> & par: points) {
+		val.push_back((*this)(par));
+	}
+	return val;
+}
+
+// covariance from the inverse of a finite-difference hessian whose stencil points are evaluated in parallel
+void fcn::hesse()
+{
+	size_t n = m_varlist.size();
+	std::vector<double> par;
+	for (variable * v: m_varlist) {
+		par.push_back(v->value());
+	}
+	gradfcn g(this);
+	std::vector<double> hess = g.hessian(par);
+
+	TMatrixDSym m(n);
+	for (size_t u = 0; u < n; ++u) {
+		for (size_t v = 0; v < n; ++v) {
+			m(u, v) = hess[u*n+v];
+		}
+	}
+	double det = 0;
+	m.Invert(&det);
+	if (det == 0) {
+		std::cout << "[fcn] error: hessian is singular, errors are not updated" << std::endl;
+		return;
+	}
+
+	m_cov.assign(n*n, 0);
+	if (m_verbose) std::cout << "parallel hesse errors: " << std::endl;
+	for (size_t u = 0; u < n; ++u) {
+		for (size_t v = 0; v < n; ++v) {
+			m_cov[u*n+v] = 2*Up()*m(u, v);
+		}
+		variable * v = m_varlist[u];
+		if (m_cov[u*n+u] > 0) v->set_err(sqrt(m_cov[u*n+u]));
+		if (m_verbose) std::cout << v->name() << " " << v->value() << " " << v->err() << std::endl;
+	}
+}
+
+fitresult fcn::minimize(bool minos_err)
 {
+	return run_fit(minos_err, false);
+}
+
+size_t fcn::ncall()
+{
+	std::lock_guard<std::mutex> lock(m_stat->mutex);
+	return m_stat->ncall;
+}
+
+// with several channels each gets a context of its own, chained to the caller's, so that channels can be
+// evaluated concurrently even when they share pdfs; caches kept in these contexts persist between calls
+void fcn::prepare_channels() const
+{
+	if (m_pdflist.size() < 2) return;
+	m_channel_ctx.resize(m_pdflist.size());
+	for (std::shared_ptr<context> & c: m_channel_ctx) {
+		if (!c) c.reset(new context);
+		c->set_parent(context::current());
+	}
+}
+
+// minimize again after events were appended to the data: the minimization starts from the last minimum, and
+// an nllfcn only sums the new events as long as the parameters of a channel do not move
+fitresult fcn::refit(bool minos_err)
+{
+	return run_fit(minos_err, true);
+}
+
+fitresult fcn::run_fit(bool minos_err, bool warm)
+{
+	fitresult res;
+	std::chrono::steady_clock::time_point wall0;
+	std::clock_t cpu0 = 0;
+	size_t ncall0 = 0;
+	auto start = [&]() {
+		wall0 = std::chrono::steady_clock::now();
+		cpu0 = std::clock();
+		ncall0 = ncall();
+	};
+	auto stop = [&](const char * name) {
+		double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+		double cpu = double(std::clock() - cpu0) / CLOCKS_PER_SEC;
+		res.m_phase.push_back({name, wall, cpu, ncall()-ncall0});
+		tracer::record(name, "fit", wall0, std::chrono::steady_clock::now(), "nfcn", ncall()-ncall0);
+	};
+
+	size_t nfcn0 = ncall();
+	std::vector<size_t> neval0 = m_stat->neval;
+
 	ROOT::Minuit2::MnUserParameters upar;
 	for (variable * v: get_var_list()) {
 		upar.Add(v->name(), v->value(), v->err());
 		upar.SetLimits(v->name(), v->limit_down(), v->limit_up());
 	}
-	ROOT::Minuit2::MnMigrad migrad(*this, upar);
-	ROOT::Minuit2::FunctionMinimum min = migrad();
+	// a refit starts from the previous minimum: its values are still in the variables, and its covariance
+	// replaces the numerical estimate of the second derivatives MIGRAD would start with
+	ROOT::Minuit2::MnUserParameterState state(upar);
+	size_t npar = m_varlist.size();
+	if (warm && m_min && m_min->IsValid() && (m_cov.size() == npar*npar || m_min->UserState().HasCovariance())) {
+		ROOT::Minuit2::MnUserCovariance cov(npar);
+		for (size_t u = 0; u < npar; ++u) {
+			for (size_t w = u; w < npar; ++w) {
+				cov(u, w) = covariance(u, w);
+			}
+		}
+		state = ROOT::Minuit2::MnUserParameterState(upar, cov);
+	}
+	m_cov.clear();
+	start();
+	if (m_parallel_deriv) {
+		gradfcn g(this);
+		ROOT::Minuit2::MnMigrad migrad(g, state);
+		m_min.reset(new ROOT::Minuit2::FunctionMinimum(migrad()));
+	}
+	else {
+		ROOT::Minuit2::MnMigrad migrad(*this, state);
+		m_min.reset(new ROOT::Minuit2::FunctionMinimum(migrad()));
+	}
+	stop("MIGRAD");
+	ROOT::Minuit2::FunctionMinimum & min = *m_min;
 	for (variable * v: get_var_list()) {
 		// seems that fit value is automatically set by minuit
 		v->set_value(min.UserState().Value(v->name()));
 		v->set_err(min.UserState().Error(v->name()));
 	}
-	std::cout << min << std::endl;
+
+	start();
+	if (m_parallel_deriv) {
+		hesse();
+	}
+	else {
+		// HESSE leaves the variables at its last stencil point, the values are put back with the errors
+		ROOT::Minuit2::MnHesse hesse;
+		hesse(*this, min);
+		for (variable * v: get_var_list()) {
+			v->set_value(min.UserState().Value(v->name()));
+			v->set_err(min.UserState().Error(v->name()));
+		}
+	}
+	stop("HESSE");
+	if (m_verbose) std::cout << min << std::endl;
 
 	if (minos_err) {
-		ROOT::Minuit2::MnMinos minos(*this, min);
-		std::cout << "1-sigma minos errors: " << std::endl;
+		// parameters are independent, each worker scans its own with a cloned fcn in a private context
+		std::vector<std::pair<double, double>> err(get_var_list().size());
+		start();
+		parallel::for_each(get_var_list().size(), [&](size_t begin, size_t end) {
+			context ctx(context::current());
+			ctx.activate();
+			std::unique_ptr<fcn> f(clone());
+			ROOT::Minuit2::MnMinos minos(*f, min);
+			for (size_t u = begin; u < end; ++u) {
+				tracer::span span("minos", "fit", "parameter", u);
+				err[u] = minos(u);
+			}
+			ctx.deactivate();
+		});
+		stop("MINOS");
+
+		if (m_verbose) std::cout << "1-sigma minos errors: " << std::endl;
 		for (size_t u = 0; u < get_var_list().size(); ++u) {
-			std::pair<double, double> e = minos(u);
+			std::pair<double, double> e = err[u];
 			variable * v = get_var(u);
 			const char * name = v->name();
-			std::cout << name << " " << min.UserState().Value(v->name()) << " " << e.first << " " << e.second << std::endl;
+			if (m_verbose) std::cout << name << " " << min.UserState().Value(v->name()) << " " << e.first << " " << e.second << std::endl;
 			v->set_value(min.UserState().Value(v->name()));
 			v->set_err_down(e.first);
 			v->set_err_up(e.second);
 		}
 	}
+
+	if (!min.IsValid()) {
+		if (min.HasReachedCallLimit()) res.m_status = 4;
+		else if (min.IsAboveMaxEdm()) res.m_status = 3;
+		else res.m_status = 5;
+	}
+	else if (!m_parallel_deriv && min.HesseFailed()) res.m_status = 2;
+	else if (!m_parallel_deriv && min.HasMadePosDefCovar()) res.m_status = 1;
+	else if (m_parallel_deriv && m_cov.empty()) res.m_status = 2;
+	else res.m_status = 0;
+	res.m_fval = min.Fval();
+	res.m_edm = min.Edm();
+	res.m_nfcn = ncall() - nfcn0;
+	size_t n = m_varlist.size();
+	for (size_t u = 0; u < n; ++u) {
+		variable * v = m_varlist[u];
+		res.m_name.push_back(v->name());
+		res.m_value.push_back(v->value());
+		res.m_err.push_back(v->err());
+		res.m_err_down.push_back(minos_err ? v->err_down() : 0);
+		res.m_err_up.push_back(minos_err ? v->err_up() : 0);
+		for (size_t w = 0; w < n; ++w) {
+			res.m_cov.push_back(covariance(u, w));
+		}
+	}
+	for (size_t u = 0; u < m_stat->neval.size(); ++u) {
+		res.m_neval.push_back(m_stat->neval[u] - neval0[u]);
+	}
+	return res;
+}
+
+// most expensive channels first, so that the thread pool hands them out before the cheap ones
+std::vector<size_t> fcn::schedule(const std::vector<size_t> & channels) const
+{
+	std::vector<size_t> order(channels);
+	std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) { return m_cost[a] > m_cost[b]; });
+	return order;
 }
 
 void fcn::update_varlist(pdf * p, dataset * d)
@@ -3,11 +3,16 @@
 
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include "Minuit2/FCNBase.h"
 #include "Minuit2/FunctionMinimum.h"
 #include "Minuit2/MnMigrad.h"
 #include "Minuit2/MnMinos.h"
+#include "fitresult.h"
 
+class context;
 class datahist;
 class dataset;
 class pdf;
@@ -16,33 +21,69 @@ class variable;
 class fcn: public ROOT::Minuit2::FCNBase
 {
 	public:
-		fcn() = default;
+		fcn();
 		fcn(pdf * p, dataset * d);
 		virtual ~fcn();
 		
 		void add(pdf * p, dataset * d);
+		std::vector<std::pair<double, double>> contour(variable * x, variable * y, size_t npoint = 20);
+		std::vector<std::vector<std::pair<double, double>>> contours(const std::vector<std::pair<variable *, variable *>> & vpairs, size_t npoint = 20);
+		double covariance(int u, int v);
 		dataset * get_data(int n) { return m_datalist[n]; }
 		std::vector<dataset *> & get_data_list() { return m_datalist; }
 		pdf * get_pdf(int n) { return m_pdflist[n]; }
 		std::vector<pdf *> & get_pdf_list() { return m_pdflist; }
 		variable * get_var(int n) { return m_varlist[n]; }
 		std::vector<variable *> & get_var_list() { return m_varlist; }
-		void minimize(bool minos_err = false);
+		void hesse();
+		fitresult minimize(bool minos_err = false);
+		double min_fval(); // at the minimum of the last fit, NaN without a valid one
+		std::vector<double> min_pars(); // values at the minimum of the last fit, empty without one
+		size_t ncall();
+		bool parallel_derivatives() { return m_parallel_deriv; }
+		fitresult refit(bool minos_err = false);
+		void set_parallel_derivatives(bool flag) { m_parallel_deriv = flag; }
+		void set_verbose(bool flag) { m_verbose = flag; }
+		bool verbose() { return m_verbose; }
 		
+		virtual fcn * clone() const = 0; // independent copy (with its own caches) for use on another thread
+		virtual std::vector<double> evaluate(const std::vector<std::vector<double>> & points) const;
 		virtual double operator()(const std::vector<double> & par) const = 0;
 		virtual double Up() const = 0;
 
 	protected:
+		// counters shared by an fcn and all its clones
+		struct callstat
+		{
+			std::mutex mutex;
+			size_t ncall;
+			std::vector<size_t> neval;
+		};
+
+	protected:
+		context * channel_context(size_t channel) const { return m_channel_ctx.empty() ? 0 : m_channel_ctx[channel].get(); }
+		void count_call(size_t n = 1) const;
+		void count_eval(size_t channel, size_t n = 1) const;
+		void prepare_channels() const;
+		void reset_channels() { m_channel_ctx.clear(); }
+		fitresult run_fit(bool minos_err, bool warm);
+		std::vector<size_t> schedule(const std::vector<size_t> & channels) const;
 		void update_varlist(pdf * p, dataset * d);
 
 	protected:
+		bool m_parallel_deriv;
+		bool m_verbose;
+		std::vector<double> m_cov;
+		std::shared_ptr<callstat> m_stat;
+		mutable std::vector<std::shared_ptr<context>> m_channel_ctx; // one per channel when channels run concurrently, never shared with clones
+		mutable std::vector<double> m_cost; // time of the last evaluation of each channel (events at start), for scheduling
 		std::vector<dataset *> m_datalist;
 		std::vector<pdf *> m_pdflist;
 		std::vector<variable *> m_varlist;
 		std::map<variable *, int> m_vcount;
 		ROOT::Minuit2::MnMigrad * m_migrad;
 		ROOT::Minuit2::MnMinos * m_minos;
-		ROOT::Minuit2::FunctionMinimum * m_min;
+		std::shared_ptr<ROOT::Minuit2::FunctionMinimum> m_min;
 };
 
 #endif
@@ -0,0 +1,79 @@
+#include <cmath>
+#include <iomanip>
+#include "fitresult.h"
+
+fitresult::fitresult():
+	m_status(-1),
+	m_edm(0),
+	m_fval(0),
+	m_nfcn(0)
+{
+}
+
+fitresult::~fitresult()
+{
+}
+
+double fitresult::corr(int u, int v)
+{
+	double d = sqrt(cov(u, u)*cov(v, v));
+	return d ? cov(u, v)/d : 0;
+}
+
+int fitresult::index(const char * name)
+{
+	for (size_t u = 0; u < m_name.size(); ++u) {
+		if (m_name[u] == name) return u;
+	}
+	return -1;
+}
+
+void fitresult::print(std::ostream & os)
+{
+	os << "fit status = " << m_status << ", fval = " << std::setprecision(10) << m_fval << std::setprecision(6);
+	os << ", edm = " << m_edm << ", fcn calls = " << m_nfcn << std::endl;
+	for (size_t u = 0; u < npar(); ++u) {
+		os << m_name[u] << " " << m_value[u] << " +- " << m_err[u];
+		if (m_err_down[u] || m_err_up[u]) os << " (" << m_err_down[u] << ", +" << m_err_up[u] << ")";
+		os << std::endl;
+	}
+	for (phase & p: m_phase) {
+		os << p.name << ": wall " << p.wall << " s, cpu " << p.cpu << " s, fcn calls " << p.nfcn << std::endl;
+	}
+	for (size_t u = 0; u < m_neval.size(); ++u) {
+		os << "pdf " << u << ": " << m_neval[u] << " evaluations" << std::endl;
+	}
+}
+
+void fitresult::print_json(std::ostream & os)
+{
+	auto list = [&os](const std::vector<double> & v) {
+		os << "[";
+		for (size_t u = 0; u < v.size(); ++u) os << (u ? ", " : "") << v[u];
+		os << "]";
+	};
+
+	os << std::setprecision(17);
+	os << "{\"status\": " << m_status << ", \"fval\": " << m_fval << ", \"edm\": " << m_edm << ", \"nfcn\": " << m_nfcn;
+	os << ", \"name\": [";
+	for (size_t u = 0; u < m_name.size(); ++u) os << (u ? ", " : "") << "\"" << m_name[u] << "\"";
+	os << "], \"value\": ";
+	list(m_value);
+	os << ", \"err\": ";
+	list(m_err);
+	os << ", \"err_down\": ";
+	list(m_err_down);
+	os << ", \"err_up\": ";
+	list(m_err_up);
+	os << ", \"cov\": ";
+	list(m_cov);
+	os << ", \"phase\": [";
+	for (size_t u = 0; u < m_phase.size(); ++u) {
+		os << (u ? ", " : "") << "{\"name\": \"" << m_phase[u].name << "\", \"wall\": " << m_phase[u].wall;
+		os << ", \"cpu\": " << m_phase[u].cpu << ", \"nfcn\": " << m_phase[u].nfcn << "}";
+	}
+	os << "], \"neval\": [";
+	for (size_t u = 0; u < m_neval.size(); ++u) os << (u ? ", " : "") << m_neval[u];
+	os << "]}" << std::endl;
+	os << std::setprecision(6);
+}
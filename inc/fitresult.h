@@ -0,0 +1,56 @@
+#ifndef FITRESULT_H__
+#define FITRESULT_H__
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// outcome of fcn::minimize: parameters, covariance, minimizer status and where the time went
+class fitresult
+{
+	public:
+		struct phase
+		{
+			std::string name;
+			double wall;
+			double cpu;
+			size_t nfcn;
+		};
+
+	public:
+		fitresult();
+		virtual ~fitresult();
+
+		double cov(int u, int v) { return m_cov[u*npar()+v]; }
+		double corr(int u, int v);
+		double edm() { return m_edm; }
+		double err(int n) { return m_err[n]; }
+		double err_down(int n) { return m_err_down[n]; }
+		double err_up(int n) { return m_err_up[n]; }
+		double fval() { return m_fval; }
+		int index(const char * name);
+		size_t nfcn() { return m_nfcn; }
+		size_t npar() { return m_name.size(); }
+		const char * name(int n) { return m_name[n].c_str(); }
+		void print(std::ostream & os = std::cout);
+		void print_json(std::ostream & os = std::cout);
+		int status() { return m_status; }
+		bool valid() { return m_status == 0; }
+		double value(int n) { return m_value[n]; }
+
+	public:
+		int m_status; // -1: not run | 0: okay | 1: covariance forced positive-definite | 2: hesse failed | 3: edm above max | 4: call limit reached | 5: invalid minimum
+		double m_edm;
+		double m_fval;
+		size_t m_nfcn;
+		std::vector<double> m_cov;
+		std::vector<double> m_err;
+		std::vector<double> m_err_down;
+		std::vector<double> m_err_up;
+		std::vector<std::string> m_name;
+		std::vector<phase> m_phase;
+		std::vector<size_t> m_neval; // per pdf (fit channel): number of times its log_sum/norm were recalculated
+		std::vector<double> m_value;
+};
+
+#endif
@@ -1,7 +1,9 @@
 #include <iostream>
 #include <cmath>
+#include "TMath.h"
 #include "dataset.h"
 #include "gaussian.h" 
+#include "vecmath.h"
 
 gaussian::gaussian(variable & m, variable & s, dataset & normset):
 	pdf(1, {&m, &s}, normset)
@@ -12,6 +14,15 @@ gaussian::~gaussian()
 {
 }
 
+// integral of exp(-(t-m)^2/2/s^2) over [lo, hi]
+bool gaussian::analytic_integral(const double * lo, const double * hi, double & value)
+{
+	double m = get_par(0);
+	double s = get_par(1);
+	value = s*sqrt(TMath::Pi()/2)*(TMath::Erf((hi[0]-m)/s/sqrt(2.0)) - TMath::Erf((lo[0]-m)/s/sqrt(2.0)));
+	return true;
+}
+
 double gaussian::evaluate(const double * x)
 {
 	double t = x[0];
@@ -19,3 +30,22 @@ double gaussian::evaluate(const double * x)
 	double s = get_par(1);
 	return exp(-(t-m)*(t-m)/2/s/s);
 }
+
+double gaussian::evaluate(const double * x, const double * par)
+{
+	double t = x[0]-par[0];
+	return exp(-t*t/2/par[1]/par[1]);
+}
+
+// 1/(2s^2) is calculated once for the batch
+void gaussian::evaluate_batch(dataset * data, size_t begin, size_t end, double * out)
+{
+	double m = get_par(0);
+	double s = get_par(1);
+	double c = -0.5/s/s;
+	for (size_t u = begin; u < end; ++u) {
+		double t = data->at(u)[0]-m;
+		out[u-begin] = c*t*t;
+	}
+	vecmath::exp(out, out, end-begin);
+}
@@ -13,7 +13,10 @@ class gaussian: public pdf
 		virtual ~gaussian();
 		
 		// override pdf
+		bool analytic_integral(const double * lo, const double * hi, double & value);
 		double evaluate(const double * x);
+		double evaluate(const double * x, const double * par);
+		void evaluate_batch(dataset * data, size_t begin, size_t end, double * out);
 };
 
 #endif
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include "context.h"
+#include "fcn.h"
+#include "gradfcn.h"
+#include "parallel.h"
+#include "variable.h"
+
+gradfcn::gradfcn(fcn * f):
+	m_fcn(f)
+{
+}
+
+gradfcn::~gradfcn()
+{
+}
+
+std::vector<double> gradfcn::evaluate(const std::vector<std::vector<double>> & points) const
+{
+	std::vector<double> val(points.size(), 0);
+	parallel::for_each(points.size(), [&](size_t begin, size_t end) {
+		context ctx(context::current());
+		ctx.activate();
+		std::unique_ptr<fcn> f(m_fcn->clone());
+		std::vector<double> v = f->evaluate(std::vector<std::vector<double>>(points.begin()+begin, points.begin()+end));
+		std::copy(v.begin(), v.end(), val.begin()+begin);
+		ctx.deactivate();
+	});
+	return val;
+}
+
+// central differences; where a limit is closer than the step, second-order one-sided differences on the side
+// with room, so that no stencil point falls outside the limits
+std::vector<double> gradfcn::Gradient(const std::vector<double> & par) const
+{
+	size_t n = par.size();
+	std::vector<int> side;
+	std::vector<double> h = step(par, &side);
+	std::vector<std::vector<double>> points(2*n, par);
+	for (size_t u = 0; u < n; ++u) {
+		points[2*u][u] += side[u] ? side[u]*h[u] : h[u];
+		points[2*u+1][u] += side[u] ? 2*side[u]*h[u] : -h[u];
+	}
+	if (std::count(side.begin(), side.end(), 0) < int(n)) points.push_back(par);
+	std::vector<double> val = evaluate(points);
+
+	std::vector<double> grad(n, 0);
+	for (size_t u = 0; u < n; ++u) {
+		if (side[u]) grad[u] = side[u] * (4*val[2*u] - val[2*u+1] - 3*val[2*n]) / (2*h[u]);
+		else grad[u] = (val[2*u] - val[2*u+1]) / (2*h[u]);
+	}
+	return grad;
+}
+
+// full matrix of second derivatives (row-major), all 1+2n+2n(n-1) stencil points (and the shifted centres of
+// parameters next to a limit, whose stencil moves a step away from it) are evaluated in one parallel batch
+std::vector<double> gradfcn::hessian(const std::vector<double> & par) const
+{
+	size_t n = par.size();
+	std::vector<int> side;
+	std::vector<double> h = step(par, &side);
+	std::vector<double> c(n);
+	for (size_t u = 0; u < n; ++u) {
+		c[u] = side[u]*h[u];
+	}
+	std::vector<std::vector<double>> points(1, par);
+	for (size_t u = 0; u < n; ++u) {
+		for (int s: {1, -1}) {
+			points.push_back(par);
+			points.back()[u] += c[u] + s*h[u];
+		}
+	}
+	for (size_t u = 0; u < n; ++u) {
+		for (size_t v = u+1; v < n; ++v) {
+			for (int su: {1, -1}) {
+				for (int sv: {1, -1}) {
+					points.push_back(par);
+					points.back()[u] += c[u] + su*h[u];
+					points.back()[v] += c[v] + sv*h[v];
+				}
+			}
+		}
+	}
+	std::vector<size_t> centre(n, 0);
+	for (size_t u = 0; u < n; ++u) {
+		if (!side[u]) continue;
+		centre[u] = points.size();
+		points.push_back(par);
+		points.back()[u] += c[u];
+	}
+	std::vector<double> val = evaluate(points);
+
+	std::vector<double> hess(n*n, 0);
+	size_t k = 1+2*n;
+	for (size_t u = 0; u < n; ++u) {
+		hess[u*n+u] = (val[1+2*u] - 2*val[centre[u]] + val[2+2*u]) / (h[u]*h[u]);
+		for (size_t v = u+1; v < n; ++v) {
+			double d = (val[k] - val[k+1] - val[k+2] + val[k+3]) / (4*h[u]*h[v]);
+			hess[u*n+v] = d;
+			hess[v*n+u] = d;
+			k += 4;
+		}
+	}
+	return hess;
+}
+
+double gradfcn::operator()(const std::vector<double> & par) const
+{
+	return (*m_fcn)(par);
+}
+
+// nominal steps, a thousandth of the error; where a limit is closer than that, side is the direction (+1 up,
+// -1 down) of the one-sided stencil and the step is kept within the room on that side, but not below a floor
+// at which differences of the fcn are lost to rounding
+std::vector<double> gradfcn::step(const std::vector<double> & par, std::vector<int> * side) const
+{
+	std::vector<double> h(par.size(), 0);
+	if (side) side->assign(par.size(), 0);
+	for (size_t u = 0; u < par.size(); ++u) {
+		variable * v = m_fcn->get_var(u);
+		double s = (v->err() > 0) ? 1e-3*v->err() : 1e-6*(1+fabs(par[u]));
+		if (v->limit_down() < v->limit_up()) {
+			double up = v->limit_up()-par[u];
+			double down = par[u]-v->limit_down();
+			if (up < s || down < s) {
+				// two steps on the side with more room
+				if (side) (*side)[u] = (up >= down) ? 1 : -1;
+				s = std::max(std::min(s, std::max(up, down)/2), 1e-8*(1+fabs(par[u])));
+			}
+		}
+		h[u] = s;
+	}
+	return h;
+}
+
+double gradfcn::Up() const
+{
+	return m_fcn->Up();
+}
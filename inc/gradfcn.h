@@ -0,0 +1,30 @@
+#ifndef GRADFCN_H__
+#define GRADFCN_H__
+
+#include <vector>
+#include "Minuit2/FCNGradientBase.h"
+
+class fcn;
+
+// wraps an fcn and provides finite-difference derivatives whose stencil points are evaluated concurrently,
+// each worker uses a clone of the fcn in a private context
+class gradfcn: public ROOT::Minuit2::FCNGradientBase
+{
+	public:
+		gradfcn(fcn * f);
+		virtual ~gradfcn();
+		
+		std::vector<double> evaluate(const std::vector<std::vector<double>> & points) const;
+		std::vector<double> hessian(const std::vector<double> & par) const;
+		std::vector<double> step(const std::vector<double> & par, std::vector<int> * side = 0) const;
+		
+		virtual bool CheckGradient() const { return false; }
+		virtual std::vector<double> Gradient(const std::vector<double> & par) const;
+		virtual double operator()(const std::vector<double> & par) const;
+		virtual double Up() const;
+
+	protected:
+		fcn * m_fcn;
+};
+
+#endif
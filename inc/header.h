@@ -1,12 +1,55 @@
+// with MSFIT_SHARED defined only the declarations are included and the code comes from libmsfit.so (make lib),
+// otherwise the sources are compiled along with the macro
+#ifdef MSFIT_SHARED
+#include "addpdf.h"
+#include "breitwigner.h"
+#include "chi2fcn.h"
+#include "context.h"
+#include "datahist.h"
+#include "dataset.h"
+#include "fcn.h"
+#include "fitresult.h"
+#include "gaussian.h"
+#include "gradfcn.h"
+#include "nllfcn.h"
+#include "numa.h"
+#include "parallel.h"
+#include "pdf.h"
+#include "profiler.h"
+#include "projection.h"
+#include "projindex.h"
+#include "projpdf.h"
+#include "sampler.h"
+#include "scan.h"
+#include "simfit.h"
+#include "toymc.h"
+#include "tracer.h"
+#include "variable.h"
+#include "vecmath.h"
+#else
 #include "addpdf.cpp"
 #include "breitwigner.cpp"
 #include "chi2fcn.cpp"
+#include "context.cpp"
 #include "datahist.cpp"
 #include "dataset.cpp"
 #include "fcn.cpp"
+#include "fitresult.cpp"
 #include "gaussian.cpp"
+#include "gradfcn.cpp"
 #include "nllfcn.cpp"
+#include "numa.cpp"
+#include "parallel.cpp"
 #include "pdf.cpp"
+#include "profiler.cpp"
+#include "projection.cpp"
+#include "projindex.cpp"
 #include "projpdf.cpp"
+#include "sampler.cpp"
+#include "scan.cpp"
 #include "simfit.cpp"
+#include "toymc.cpp"
+#include "tracer.cpp"
 #include "variable.cpp"
+#include "vecmath.cpp"
+#endif
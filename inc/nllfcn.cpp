@@ -1,17 +1,26 @@
 #include <iostream>
+#include <chrono>
 #include <cmath>
+#include <memory>
 #include "addpdf.h"
+#include "context.h"
 #include "dataset.h"
 #include "fcn.h"
 #include "nllfcn.h"
+#include "parallel.h"
 #include "pdf.h"
+#include "profiler.h"
+#include "tracer.h"
 #include "variable.h"
 
 nllfcn::nllfcn(pdf * p, dataset * d):
 	fcn(p, d),
 	m_arr_logsum(1),
-	m_arr_norm(1, -1)
+	m_arr_nevent(1, 0),
+	m_arr_norm(1, -1),
+	m_arr_par(1)
 {
+	precompute(p, d);
 }
 
 nllfcn::~nllfcn()
@@ -22,7 +31,17 @@ void nllfcn::add(pdf * p, dataset * d)
 {
 	fcn::add(p, d);
 	m_arr_logsum.push_back(1);
+	m_arr_nevent.push_back(0);
 	m_arr_norm.push_back(-1);
+	m_arr_par.emplace_back();
+	precompute(p, d);
+}
+
+fcn * nllfcn::clone() const
+{
+	nllfcn * f = new nllfcn(*this);
+	f->reset_channels();
+	return f;
 }
 
 double nllfcn::operator()(const std::vector<double> & par) const
@@ -32,16 +51,132 @@ double nllfcn::operator()(const std::vector<double> & par) const
 		//cout << u << " " << par[u] << endl;
 	}
 
+	count_call();
+	PROFILE_SCOPE(this, "nll");
+	prepare_channels();
+	// the sums of a channel are kept with the parameter values they belong to: while these do not move, only
+	// events appended to the data since the last call are summed (see refit)
+	std::vector<size_t> todo;
+	std::vector<bool> full(m_pdflist.size(), false);
+	for (size_t u = 0; u < m_pdflist.size(); ++u) {
+		context * c = channel_context(u);
+		if (c) c->activate();
+		std::vector<double> par = m_pdflist[u]->get_pars();
+		if (par != m_arr_par[u] || m_arr_norm[u] < 0) {
+			todo.push_back(u);
+			full[u] = true;
+			m_arr_par[u] = par;
+		}
+		if (c) c->deactivate();
+	}
+	PROFILE_ADD(cache_miss, todo.size());
+	PROFILE_ADD(cache_hit, m_pdflist.size()-todo.size());
+
+	// normalization: channels sharing a normset are normalized together with one pass over it
+	todo = schedule(todo);
+	std::vector<std::pair<pdf *, context *>> plist;
+	for (size_t u: todo) {
+		plist.push_back(std::make_pair(m_pdflist[u], channel_context(u)));
+	}
+	pdf::normalize_all(plist);
+	for (size_t u: todo) {
+		context * c = channel_context(u);
+		if (c) c->activate();
+		m_arr_norm[u] = m_pdflist[u]->norm();
+		if (c) c->deactivate();
+	}
+
+	// log_sum in pieces of a fixed number of events, so that one dominant channel is still spread over all
+	// threads; partial sums are added in a fixed order, the result does not depend on the number of threads
+	std::vector<piece> pieces;
+	for (size_t u = 0; u < m_pdflist.size(); ++u) {
+		size_t n = m_datalist[u]->size();
+		size_t first = full[u] ? 0 : m_arr_nevent[u];
+		if (!full[u] && first >= n) continue;
+		for (size_t b = first; b < n || b == first; b += piece_size) {
+			pieces.push_back({u, b, std::min(b+piece_size, n), 0, 0});
+		}
+		m_arr_nevent[u] = n;
+	}
+	parallel::for_each(pieces.size(), [&](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; ++k) {
+			piece & q = pieces[k];
+			tracer::span span("log_sum", "nll", "channel", q.channel);
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			context * c = channel_context(q.channel);
+			if (c) c->activate();
+			q.value = m_pdflist[q.channel]->log_sum(m_datalist[q.channel], q.begin, q.end);
+			if (c) c->deactivate();
+			q.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		}
+	});
+	for (size_t u: todo) {
+		m_arr_logsum[u] = 0;
+		m_cost[u] = 0;
+		count_eval(u);
+	}
+	for (const piece & q: pieces) {
+		m_arr_logsum[q.channel] += q.value;
+		if (full[q.channel]) m_cost[q.channel] += q.time;
+	}
+
 	double nll = 0;
+	for (size_t u = 0; u < m_pdflist.size(); ++u) {
+		nll -= m_arr_logsum[u];
+		nll -= log(m_arr_norm[u])*m_datalist[u]->nevt();
+	}
+	return nll;
+}
+
+// nll at several parameter points with one traversal of each normset and dataset, see pdf::log_sum
+std::vector<double> nllfcn::evaluate(const std::vector<std::vector<double>> & points) const
+{
+	std::vector<std::unique_ptr<context>> ctx;
+	std::vector<context *> cptr;
+	for (const std::vector<double> & par: points) {
+		ctx.emplace_back(new context(context::current()));
+		cptr.push_back(ctx.back().get());
+		for (size_t u = 0; u < m_varlist.size(); ++u) {
+			ctx.back()->set_value(m_varlist[u]->id(), par[u]);
+		}
+	}
+
+	count_call(points.size());
+	PROFILE_SCOPE(this, "nll[n]");
+	PROFILE_ADD(cache_miss, points.size()*m_pdflist.size());
+	std::vector<std::pair<pdf *, context *>> plist;
+	for (size_t u = 0; u < m_pdflist.size(); ++u) {
+		for (context * c: cptr) {
+			plist.push_back(std::make_pair(m_pdflist[u], c));
+		}
+	}
+	pdf::normalize_all(plist);
+
+	std::vector<double> nll(points.size(), 0);
 	for (size_t u = 0; u < m_pdflist.size(); ++u) {
 		pdf * p = m_pdflist[u];
 		dataset * d = m_datalist[u];
-		if (p->updated() || m_arr_norm[u] < 0) {
-			m_arr_logsum[u] = p->log_sum(d);
-			m_arr_norm[u] = p->norm();
+		count_eval(u, points.size());
+		tracer::span span("channel[n]", "nll", "channel", u);
+		std::vector<double> norm = p->norm(cptr);
+		std::vector<double> logsum = p->log_sum(d, cptr);
+		for (size_t k = 0; k < points.size(); ++k) {
+			nll[k] -= logsum[k];
+			nll[k] -= log(norm[k])*d->nevt();
 		}
-		nll -= m_arr_logsum[u];
-		nll -= log(m_arr_norm[u])*d->nevt();
 	}
 	return nll;
 }
+
+// components that depend on no floating parameter are evaluated once over the data, the arrays are shared by
+// clones of this fcn (MINOS, contours, scans); their norms do not change either and stay in the norm cache
+void nllfcn::precompute(pdf * p, dataset * d)
+{
+	if (!d) return;
+	for (pdf * q: p->components()) {
+		if (q->constant()) m_precomputed.push_back(q->precompute(d));
+		else precompute(q, d);
+	}
+}
+
+size_t nllfcn::piece_size = 65536;
@@ -5,6 +5,7 @@
 #include <map>
 #include "TMath.h"
 #include "fcn.h"
+#include "pdf.h"
 
 class addpdf;
 class dataset;
@@ -20,12 +21,32 @@ class nllfcn: public fcn
 		
 		void add(pdf * p, dataset * d);
 		
+		virtual fcn * clone() const;
+		virtual std::vector<double> evaluate(const std::vector<std::vector<double>> & points) const;
 		virtual double operator()(const std::vector<double> & par) const;
 		virtual double Up() const { return 0.5; }
 
+		static size_t piece_size; // events per log_sum task when channels are evaluated on the thread pool
+
+	protected:
+		struct piece
+		{
+			size_t channel;
+			size_t begin;
+			size_t end;
+			double value;
+			double time;
+		};
+
+	protected:
+		void precompute(pdf * p, dataset * d);
+
 	protected:
 		mutable std::vector<double> m_arr_logsum;
+		mutable std::vector<size_t> m_arr_nevent; // events summed in m_arr_logsum
 		mutable std::vector<double> m_arr_norm;
+		mutable std::vector<std::vector<double>> m_arr_par; // parameter values of the pdf m_arr_logsum and m_arr_norm belong to
+		std::vector<std::shared_ptr<pdf::precomputed>> m_precomputed;
 };
 
 #endif
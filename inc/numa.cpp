@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#include "numa.h"
+
+// the current thread may run on the cpus of the node only, false if this is not supported
+bool numa::bind(size_t node)
+{
+	if (node >= nnode()) return false;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu: cpus(node)) {
+		CPU_SET(cpu, &set);
+	}
+	return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	return false;
+#endif
+}
+
+const std::vector<int> & numa::cpus(size_t node)
+{
+	return topology().at(node);
+}
+
+size_t numa::nnode()
+{
+	return topology().size();
+}
+
+// node of each page of [p, p+bytes), -1 for a page that is not backed by memory yet or if this is not supported
+std::vector<int> numa::nodes_of(const void * p, size_t bytes)
+{
+#ifdef __linux__
+	size_t page = sysconf(_SC_PAGESIZE);
+#else
+	size_t page = 4096;
+#endif
+	size_t first = size_t(p) / page;
+	size_t last = (size_t(p) + bytes + page - 1) / page;
+	std::vector<int> status(last > first ? last-first : 0, -1);
+#if defined(__linux__) && defined(SYS_move_pages)
+	// move_pages without target nodes only reports where the pages are
+	std::vector<void *> pages(status.size());
+	for (size_t u = 0; u < pages.size(); ++u) {
+		pages[u] = (void *)((first+u)*page);
+	}
+	if (!pages.empty() && syscall(SYS_move_pages, 0, pages.size(), &pages[0], (const int *)0, &status[0], 0) != 0) {
+		std::fill(status.begin(), status.end(), -1);
+	}
+	for (int & s: status) {
+		if (s < 0) s = -1;
+	}
+#endif
+	return status;
+}
+
+// cpus of each node, nodes without cpus are left out
+const std::vector<std::vector<int>> & numa::topology()
+{
+	static const std::vector<std::vector<int>> nodes = []() {
+		std::vector<std::vector<int>> n;
+#ifdef __linux__
+		std::vector<int> id;
+		if (DIR * dir = opendir("/sys/devices/system/node")) {
+			while (dirent * e = readdir(dir)) {
+				std::string name(e->d_name);
+				if (name.compare(0, 4, "node") == 0 && name.size() > 4 && isdigit(name[4])) id.push_back(std::stoi(name.substr(4)));
+			}
+			closedir(dir);
+		}
+		std::sort(id.begin(), id.end());
+		for (int node: id) {
+			// cpulist is a comma separated list of ranges: 0-7,16-23
+			std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string range;
+			std::vector<int> cpu;
+			while (std::getline(in, range, ',')) {
+				std::istringstream is(range);
+				int lo = 0, hi = 0;
+				char dash = 0;
+				if (!(is >> lo)) continue;
+				hi = (is >> dash >> hi) ? hi : lo;
+				for (int c = lo; c <= hi; ++c) {
+					cpu.push_back(c);
+				}
+			}
+			if (!cpu.empty()) n.push_back(cpu);
+		}
+#endif
+		if (n.empty()) {
+			n.emplace_back();
+			for (unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); ++c) {
+				n.back().push_back(c);
+			}
+		}
+		return n;
+	}();
+	return nodes;
+}
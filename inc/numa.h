@@ -0,0 +1,20 @@
+#ifndef NUMA_H__
+#define NUMA_H__
+
+#include <vector>
+
+// NUMA topology of the machine, read from /sys/devices/system/node on Linux (one node holding every cpu
+// elsewhere); threads can be bound to the cpus of a node and pages queried for the node they are on
+class numa
+{
+	public:
+		static bool bind(size_t node);
+		static const std::vector<int> & cpus(size_t node);
+		static size_t nnode();
+		static std::vector<int> nodes_of(const void * p, size_t bytes);
+
+	private:
+		static const std::vector<std::vector<int>> & topology();
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include "context.h"
+#include "numa.h"
+#include "parallel.h"
+#include "tracer.h"
+
+parallel::parallel(size_t n, bool numa):
+	m_stop(false),
+	m_busy(0),
+	m_context(0),
+	m_generation(0),
+	m_n(0),
+	m_nchunk(0),
+	m_next(0),
+	m_func(0),
+	m_numa(numa)
+{
+	// the calling thread takes part in every job, so only n-1 workers are started; a NUMA-aware pool has n bound
+	// workers and the calling thread, which may run on any node, only waits for them
+	size_t nworker = numa ? n : n-1;
+	if (numa) m_cursor.reset(new std::atomic<size_t>[nworker]);
+	for (size_t u = 1; u <= nworker; ++u) {
+		m_workers.emplace_back(&parallel::work, this, int(u), numa ? int((u-1)*numa::nnode()/nworker) : -1);
+	}
+}
+
+parallel::~parallel()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv_job.notify_all();
+	for (std::thread & t: m_workers) {
+		t.join();
+	}
+}
+
+// every share handed out and no worker busy
+bool parallel::done()
+{
+	if (m_busy) return false;
+	if (!m_numa) return true;
+	for (size_t j = 0; j < m_workers.size(); ++j) {
+		if (m_cursor[j] < (j+1)*m_nchunk/m_workers.size()) return false;
+	}
+	return true;
+}
+
+void parallel::for_each(size_t n, const std::function<void(size_t, size_t)> & func, size_t grain)
+{
+	if (!n) return;
+	if (inside() || nthread() < 2) {
+		func(0, n);
+		return;
+	}
+
+	parallel & p = pool();
+	size_t nc = p.nchunk(n, grain);
+	if (nc < 2) func(0, n);
+	else p.run(n, nc, func);
+}
+
+bool & parallel::inside()
+{
+	static thread_local bool flag = false;
+	return flag;
+}
+
+size_t parallel::nchunk(size_t n, size_t grain)
+{
+	// a few chunks per thread so that uneven chunks are balanced by whoever is free
+	size_t nc = (n + std::max<size_t>(grain, 1) - 1) / std::max<size_t>(grain, 1);
+	nc = std::min(nc, 4*(m_workers.size()+1));
+	// the shares of the workers then start at the same index for every job over [0, n), whatever the grain
+	if (m_numa && nc > m_workers.size()) nc -= nc % m_workers.size();
+	return nc;
+}
+
+bool parallel::numa_aware()
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	return pool_numa < 0 ? numa::nnode() > 1 : pool_numa;
+}
+
+size_t parallel::nthread()
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	if (!pool_size) pool_size = std::max(1u, std::thread::hardware_concurrency());
+	return pool_size;
+}
+
+parallel & parallel::pool()
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	if (!pool_size) pool_size = std::max(1u, std::thread::hardware_concurrency());
+	if (!pool_instance) pool_instance.reset(new parallel(pool_size, pool_numa < 0 ? numa::nnode() > 1 : pool_numa));
+	return *pool_instance;
+}
+
+double parallel::reduce(size_t n, const std::function<double(size_t, size_t)> & func, size_t grain)
+{
+	if (!n) return 0;
+	if (inside() || nthread() < 2) return func(0, n);
+
+	// partial sums are kept per chunk and added in order, so the result does not depend on scheduling
+	parallel & p = pool();
+	size_t nc = p.nchunk(n, grain);
+	if (nc < 2) return func(0, n);
+	std::vector<double> partial(nc, 0);
+	p.run(nc, nc, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			partial[c] = func(c*n/nc, (c+1)*n/nc);
+		}
+	});
+	double s = 0;
+	for (double v: partial) s += v;
+	return s;
+}
+
+void parallel::run(size_t n, size_t nchunk, const std::function<void(size_t, size_t)> & func)
+{
+	std::lock_guard<std::mutex> submit(m_submit);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_context = context::current();
+		m_func = &func;
+		m_n = n;
+		m_nchunk = nchunk;
+		m_next = 0;
+		for (size_t j = 0; m_numa && j < m_workers.size(); ++j) {
+			m_cursor[j] = j*nchunk/m_workers.size();
+		}
+		++m_generation;
+	}
+	m_cv_job.notify_all();
+
+	inside() = true;
+	if (!m_numa) run_chunks(0);
+	inside() = false;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cv_done.wait(lock, [this] { return done(); });
+	m_func = 0;
+}
+
+void parallel::run_chunk(size_t c)
+{
+	tracer::span span("chunk", "parallel", "chunk", c);
+	(*m_func)(c*m_n/m_nchunk, (c+1)*m_n/m_nchunk);
+}
+
+// a NUMA-aware worker takes the chunks of its own share first, the part of [0, n) whose data it touched first
+// (see dataset::acquire_resourse), then helps the others, nearest ids first as they are on the same node
+void parallel::run_chunks(int id)
+{
+	if (!m_numa) {
+		for (size_t c = m_next++; c < m_nchunk; c = m_next++) {
+			run_chunk(c);
+		}
+		return;
+	}
+	size_t nw = m_workers.size();
+	for (size_t k = 0; k < nw; ++k) {
+		size_t j = (id-1+k) % nw;
+		size_t end = (j+1)*m_nchunk/nw;
+		for (size_t c = m_cursor[j]++; c < end; c = m_cursor[j]++) {
+			run_chunk(c);
+		}
+	}
+}
+
+// NUMA-aware pool on or off, by default on if the machine has several nodes
+void parallel::set_numa(bool flag)
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	pool_numa = flag;
+	pool_instance.reset();
+}
+
+void parallel::set_nthread(size_t n)
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	pool_size = std::max<size_t>(n, 1);
+	pool_instance.reset();
+}
+
+int & parallel::worker_id()
+{
+	static thread_local int id = 0;
+	return id;
+}
+
+void parallel::work(int id, int node)
+{
+	worker_id() = id;
+	inside() = true;
+	if (node >= 0) numa::bind(node);
+	size_t generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv_job.wait(lock, [&] { return m_stop || (m_func && m_generation != generation); });
+			if (m_stop) return;
+			generation = m_generation;
+			++m_busy;
+			context::set_current(m_context);
+		}
+		run_chunks(id);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			context::set_current(0);
+			--m_busy;
+		}
+		m_cv_done.notify_all();
+	}
+}
+
+// node of worker id (1, 2, ...) of a NUMA-aware pool, consecutive workers share a node; -1 for another pool
+int parallel::worker_node(int id)
+{
+	size_t n = nthread();
+	if (!numa_aware() || id < 1 || size_t(id) > n) return -1;
+	return (id-1)*numa::nnode()/n;
+}
+
+std::mutex parallel::pool_mutex;
+int parallel::pool_numa = -1;
+size_t parallel::pool_size = 0;
+std::unique_ptr<parallel> parallel::pool_instance;
@@ -0,0 +1,67 @@
+#ifndef PARALLEL_H__
+#define PARALLEL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class context;
+
+// persistent pool of worker threads, [0, n) is split into chunks that are handed out dynamically;
+// workers run with the context of the calling thread. On a machine with several NUMA nodes the workers are
+// bound to nodes and each one owns an equal share of the chunks of every job (see set_numa)
+class parallel
+{
+	public:
+		virtual ~parallel();
+
+		static void for_each(size_t n, const std::function<void(size_t, size_t)> & func, size_t grain = 1);
+		static size_t nthread();
+		static bool numa_aware();
+		static double reduce(size_t n, const std::function<double(size_t, size_t)> & func, size_t grain = 1);
+		static void set_nthread(size_t n);
+		static void set_numa(bool flag);
+		static int thread_id() { return worker_id(); }
+		static int worker_node(int id);
+
+	private:
+		parallel(size_t n, bool numa);
+		bool done();
+		size_t nchunk(size_t n, size_t grain);
+		void run(size_t n, size_t nchunk, const std::function<void(size_t, size_t)> & func);
+		void run_chunk(size_t c);
+		void run_chunks(int id);
+		void work(int id, int node);
+
+		static bool & inside();
+		static parallel & pool();
+		static int & worker_id();
+
+	private:
+		bool m_stop;
+		size_t m_busy;
+		context * m_context;
+		size_t m_generation;
+		size_t m_n;
+		size_t m_nchunk;
+		std::atomic<size_t> m_next;
+		bool m_numa;
+		std::unique_ptr<std::atomic<size_t>[]> m_cursor; // next chunk of the share of each worker, NUMA-aware pool
+		const std::function<void(size_t, size_t)> * m_func;
+		std::condition_variable m_cv_done;
+		std::condition_variable m_cv_job;
+		std::mutex m_mutex;
+		std::mutex m_submit;
+		std::vector<std::thread> m_workers;
+
+		static std::mutex pool_mutex;
+		static int pool_numa; // -1: NUMA-aware if the machine has several nodes
+		static size_t pool_size;
+		static std::unique_ptr<parallel> pool_instance;
+};
+
+#endif
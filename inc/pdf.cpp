@@ -1,33 +1,41 @@
 #include <iostream>
+#include <algorithm>
+#include <functional>
 #include "Minuit2/FunctionMinimum.h"
 #include "Minuit2/MnMigrad.h"
 #include "Minuit2/MnMinos.h"
 #include "Minuit2/MnUserParameters.h"
+#include "TRandom3.h"
+#include "chi2fcn.h"
+#include "context.h"
 #include "dataset.h"
 #include "fcn.h"
 #include "nllfcn.h"
+#include "parallel.h"
 #include "pdf.h" 
+#include "profiler.h"
+#include "sampler.h"
+#include "tracer.h"
 #include "variable.h"
+#include "vecmath.h"
 
 pdf::pdf():
-	m_norm(1),
-	m_status(-1),
-	m_normalized(false),
-	m_normset(0)
+	m_cache({false, -1, 1}),
+	m_normset(0),
+	m_precomputed(new precomputedlist)
 {
 }
 
 pdf::pdf(size_t dim, const std::vector<variable *> & vlist, dataset & normset):
 	m_dim(dim),
-	m_norm(1),
-	m_status(-1),
-	m_normalized(false),
-	m_normset(&normset)
+	m_cache({false, -1, 1}),
+	m_normset(&normset),
+	m_precomputed(new precomputedlist)
 {
 	assert(dim <= normset.dim());
 	for (variable * v: vlist) {
 		m_varlist.push_back(v);
-		m_lastvalue.push_back(v->value()-0.1); // make sure the first call of updated() will return true
+		m_cache.lastvalue.push_back(v->value()-0.1); // make sure the first call of updated() will return true
 	}
 }
 
@@ -35,6 +43,25 @@ pdf::~pdf()
 {
 }
 
+// sum over a flat normset as the closed-form integral gives it, false if the normset is not flat or the integral unknown
+bool pdf::analytic_sum(double & s)
+{
+	if (!m_normset || !m_normset->flat()) return false;
+	double v = 0;
+	if (!analytic_integral(&m_normset->flat_lo()[0], &m_normset->flat_hi()[0], v)) return false;
+	s = m_normset->nevt() * v / m_normset->flat_volume(m_dim);
+	return true;
+}
+
+// relative difference between the sums over the binned surrogate and over the normset at the current values,
+// 0 if there is no surrogate; costs one pass over the normset
+double pdf::binned_norm_error()
+{
+	if (!m_binned || !m_normset) return 0;
+	double exact = sum(m_normset);
+	return exact ? sum(m_binned.get())/exact-1 : 0;
+}
+
 double pdf::calculate_area(TH1 * h)
 {
 	double a = 0;
@@ -44,10 +71,19 @@ double pdf::calculate_area(TH1 * h)
 	return a;
 }
 
-void pdf::chi2fit(datahist & data, bool minos_err)
+fitresult pdf::chi2fit(datahist & data, bool minos_err)
 {
+	if (context::current()) return chi2fcn(this, &data).minimize(minos_err);
 	chi2fcn * chi2 = create_chi2(&data);
-	chi2->minimize(minos_err);
+	return chi2->minimize(minos_err);
+}
+
+bool pdf::constant()
+{
+	for (variable * v: m_varlist) {
+		if (!v->constant()) return false;
+	}
+	return true;
 }
 
 nllfcn * pdf::create_nll(dataset * data)
@@ -95,20 +131,63 @@ void pdf::draw(TH2 * h, TH2 * hnorm, const char * option)
 	}
 }
 
-void pdf::fit(dataset & data, bool minos_err)
+fitresult pdf::fit(dataset & data, bool minos_err)
 {
+	// inside a context the fcn belongs to this call only, fits of the same pdf may run concurrently in other contexts
+	if (context::current()) return nllfcn(this, &data).minimize(minos_err);
 	nllfcn * nll = create_nll(&data);
-	nll->minimize(minos_err);
+	return nll->minimize(minos_err);
+}
+
+// fit after events were appended to data: the nll of the last fit of the same data is kept, see fcn::refit
+fitresult pdf::refit(dataset & data, bool minos_err)
+{
+	if (context::current() || !m_nll || m_nll->get_data(0) != &data) return fit(data, minos_err);
+	return m_nll->refit(minos_err);
+}
+
+// unnormalized values of events [begin, end) of data, derived classes may override it to hoist per-call work out of the event loop;
+// parameters are resolved once for the whole range and passed to evaluate packed
+void pdf::evaluate_batch(dataset * data, size_t begin, size_t end, double * out)
+{
+	std::vector<double> par = get_pars();
+	for (size_t u = begin; u < end; ++u) {
+		out[u-begin] = evaluate(data->at(u), par.data());
+	}
+}
+
+// unnormalized values of the events of data listed in index, as evaluate_batch for events that are not contiguous
+void pdf::evaluate_indexed(dataset * data, const std::vector<size_t> & index, double * out)
+{
+	std::vector<double> par = get_pars();
+	for (size_t k = 0; k < index.size(); ++k) {
+		out[k] = evaluate(data->at(index[k]), par.data());
+	}
+}
+
+// n events drawn from the normset with probability weight*pdf at the current values, the same seed gives the same events
+std::shared_ptr<dataset> pdf::generate(size_t n, unsigned seed)
+{
+	std::shared_ptr<sampler> s = get_sampler();
+	if (!s) return std::shared_ptr<dataset>();
+	TRandom3 rndm(seed);
+	return s->generate(n, rndm);
+}
+
+pdf::normcache & pdf::get_cache()
+{
+	context * c = context::current();
+	return c ? c->state(&m_cache, m_cache) : m_cache;
 }
 
 double pdf::get_lastvalue(int n)
 {
-	return m_lastvalue[n];
+	return get_cache().lastvalue[n];
 }
 
 std::vector<double> & pdf::get_lastvalues()
 {
-	return m_lastvalue;
+	return get_cache().lastvalue;
 }
 
 double pdf::get_par(int n)
@@ -116,6 +195,62 @@ double pdf::get_par(int n)
 	return m_varlist[n]->value();
 }
 
+std::vector<double> pdf::get_pars()
+{
+	std::vector<double> par(m_varlist.size());
+	for (size_t u = 0; u < m_varlist.size(); ++u) {
+		par[u] = m_varlist[u]->value();
+	}
+	return par;
+}
+
+// values of events [begin, end) of data from a precomputed array, false if the pdf has a floating parameter or
+// there is no array of data for the current parameter values
+bool pdf::get_precomputed(dataset * data, size_t begin, size_t end, double * out)
+{
+	if (!constant()) return false;
+	std::shared_lock<std::shared_mutex> lock(m_precomputed->mutex);
+	for (std::weak_ptr<precomputed> & w: m_precomputed->list) {
+		std::shared_ptr<precomputed> p = w.lock();
+		if (!p || p->data != data || p->val.size() < end) continue;
+		bool same = true;
+		for (size_t u = 0; u < m_varlist.size() && same; ++u) {
+			same = (p->par[u] == get_par(u));
+		}
+		if (same) {
+			std::copy(p->val.begin()+begin, p->val.begin()+end, out);
+			return true;
+		}
+	}
+	return false;
+}
+
+// alias table over the normset at the current values, rebuilt only when a parameter has changed
+std::shared_ptr<sampler> pdf::get_sampler()
+{
+	context * ctx = context::current();
+	samplercache & c = ctx ? ctx->state(&m_sampler, m_sampler) : m_sampler;
+	std::vector<double> par = get_pars();
+	if (c.table && c.par == par) return c.table;
+
+	if (!m_normset || !m_normset->size()) {
+		std::cout << "[pdf] error: cannot generate events without a normset" << std::endl;
+		return std::shared_ptr<sampler>();
+	}
+	norm();
+	std::vector<double> w(m_normset->size());
+	parallel::for_each(m_normset->size(), [&](size_t begin, size_t end) {
+		m_normset->wait(end);
+		evaluate_batch(m_normset, begin, end, &w[begin]);
+		for (size_t u = begin; u < end; ++u) {
+			w[u] = std::max(w[u], 0.0) * std::max(m_normset->weight(u), 0.0);
+		}
+	}, block_size);
+	c.table.reset(new sampler(m_normset, w));
+	c.par = par;
+	return c.table;
+}
+
 variable * pdf::get_var(int n)
 {
 	return m_varlist[n];
@@ -130,15 +265,33 @@ std::vector<variable *> & pdf::get_vars()
 double pdf::integral(double a, double b, int n)
 {
 	if (!m_normset || !m_normset->nevt()) return 0;
+	if (n < 0 || size_t(n) >= m_normset->dim()) {
+		std::cout << "[pdf] error: out of allowed dimension 0 ~ " << m_normset->dim()-1 << std::endl;
+		return 0;
+	}
 
 	int sign = (a < b) ? 1 : -1;
 	double min = (a < b) ? a : b;
 	double max = (a < b) ? b : a;
+	bool own = size_t(n) < m_dim; // a dimension of the pdf, else one the normset carries beyond them
+	if (m_normset->flat() && own) {
+		std::vector<double> lo(m_normset->flat_lo());
+		std::vector<double> hi(m_normset->flat_hi());
+		lo[n] = std::max(lo[n], min);
+		hi[n] = std::min(hi[n], max);
+		if (lo[n] >= hi[n]) return 0;
+		double v = 0;
+		if (analytic_integral(&lo[0], &hi[0], v)) return sign*v*norm()/m_normset->flat_volume(m_dim);
+	}
+
 	double intval = 0;
-	for (size_t u = 0; u < m_normset->nevt(); ++u) {
-		double d = m_normset->at(u)[n];
+	std::vector<double> par = get_pars();
+	dataset * source = own ? norm_source() : m_normset;
+	source->wait();
+	for (size_t u = 0; u < source->size(); ++u) {
+		double d = source->at(u)[n];
 		if (d > min && d < max) {
-			intval += evaluate(m_normset->at(u)) * m_normset->weight(u); //TODO: check here
+			intval += evaluate(source->at(u), par.data()) * source->weight(u); //TODO: check here
 		}
 	}
 	return sign*intval*norm()/m_normset->nevt();
@@ -147,44 +300,218 @@ double pdf::integral(double a, double b, int n)
 double pdf::log_sum(dataset * data)
 {
 	if (!data) return 1e-20;
+	return log_sum(data, 0, data->size());
+}
 
+// events [begin, end) only, a large dataset can be summed in pieces on several threads
+double pdf::log_sum(dataset * data, size_t begin, size_t end)
+{
+	PROFILE_SCOPE(this, "log_sum");
+	PROFILE_ADD(events, end-begin);
+	PROFILE_ADD(bytes, (end-begin)*(data->dim()+1)*sizeof(double));
 	double log_sum = 0;
-	for (size_t u = 0; u < data->size(); ++u) {
-		double v = evaluate(data->at(u));
-		if (v > 0) log_sum += log(v) * data->weight(u);
+	std::vector<double> val(block_size);
+	std::vector<double> lv(block_size);
+	for (size_t b = begin; b < end; b += block_size) {
+		size_t e = std::min(b+block_size, end);
+		data->wait(e);
+		evaluate_batch(data, b, e, &val[0]);
+		vecmath::log(&val[0], &lv[0], e-b);
+		for (size_t u = b; u < e; ++u) {
+			if (val[u-b] > 0) log_sum += lv[u-b] * data->weight(u);
+		}
 	}
 	return log_sum;
 }
 
+// log_sum at several parameter points (one context each) in a single pass over the data:
+// each block of events is evaluated for all points before moving on, so it is read from memory once
+std::vector<double> pdf::log_sum(dataset * data, const std::vector<context *> & ctx)
+{
+	std::vector<double> ls(ctx.size(), 1e-20);
+	if (!data) return ls;
+
+	PROFILE_SCOPE(this, "log_sum[n]");
+	PROFILE_ADD(events, data->size()*ctx.size());
+	PROFILE_ADD(bytes, data->size()*(data->dim()+1)*sizeof(double));
+	std::fill(ls.begin(), ls.end(), 0);
+	std::vector<double> val(block_size);
+	std::vector<double> lv(block_size);
+	for (size_t b = 0; b < data->size(); b += block_size) {
+		size_t e = std::min(b+block_size, data->size());
+		data->wait(e);
+		for (size_t k = 0; k < ctx.size(); ++k) {
+			ctx[k]->activate();
+			evaluate_batch(data, b, e, &val[0]);
+			vecmath::log(&val[0], &lv[0], e-b);
+			for (size_t u = b; u < e; ++u) {
+				if (val[u-b] > 0) ls[k] += lv[u-b] * data->weight(u);
+			}
+			ctx[k]->deactivate();
+		}
+	}
+	return ls;
+}
+
 double pdf::norm()
 {
-	m_status = normalize();
+	normcache & c = get_cache();
+	int status = normalize();
+	// only written on change: with a valid cache, concurrent calls from several threads just read
+	if (c.status != status) c.status = status;
 
-	if (m_status) {
-		std::cout << "[pdf] error: pdf not normalized, status = " << m_status;
+	if (c.status) {
+		std::cout << "[pdf] error: pdf not normalized, status = " << c.status;
 		std::cout << " (-1: null normset | 0: all okay | 1: integral on normset is 0)" << std::endl;
 	}
 
-	return m_norm;
+	return c.norm;
+}
+
+// normalization at several parameter points, points whose cached norm is still valid are not recalculated
+std::vector<double> pdf::norm(const std::vector<context *> & ctx)
+{
+	PROFILE_SCOPE(this, "normalize[n]");
+	std::vector<context *> todo;
+	for (context * c: ctx) {
+		c->activate();
+		double s = 0;
+		if (!get_cache().normalized || updated()) {
+			if (analytic_sum(s)) set_norm(s);
+			else todo.push_back(c);
+		}
+		c->deactivate();
+	}
+	PROFILE_ADD(norm_calc, todo.size());
+	PROFILE_ADD(norm_reuse, ctx.size()-todo.size());
+
+	if (!todo.empty() && m_normset && m_normset->size()) {
+		tracer::span span("normalize[n]", "pdf", "points", todo.size());
+		std::vector<double> s = sum(norm_source(), todo);
+		for (size_t k = 0; k < todo.size(); ++k) {
+			todo[k]->activate();
+			set_norm(s[k]);
+			todo[k]->deactivate();
+		}
+	}
+
+	std::vector<double> n;
+	for (context * c: ctx) {
+		c->activate();
+		n.push_back(norm());
+		c->deactivate();
+	}
+	return n;
 }
 
 int pdf::normalize()
 {
-	if (!m_normalized || updated()) {
-		m_normalized = false;
-		m_norm = 1;
-		if (!m_normset || !m_normset->nevt()) return -1;
+	normcache & c = get_cache();
+	if (!c.normalized || updated()) {
+		// only a recalculation is profiled, a cached norm is read once per event by some callers
+		PROFILE_SCOPE(this, "normalize");
+		PROFILE_ADD(norm_calc, 1);
+		tracer::span span("normalize", "pdf");
+		c.normalized = false;
+		c.norm = 1;
+		if (!m_normset || !m_normset->size()) return -1;
+
+		double s = 0;
+		if (!analytic_sum(s)) s = sum(norm_source());
+		return set_norm(s);
+	}
+	return c.status;
+}
+
+// every pdf of the list (in the context it is paired with, 0 for the current one) whose norm is out of date,
+// an addpdf through its components; pdfs with a closed-form integral on a flat normset skip the pass, pdfs
+// sharing a normset (or binned surrogate) are summed together in one traversal of it, so it is read from
+// memory once however many pdfs are normalized on it
+void pdf::normalize_all(const std::vector<std::pair<pdf *, context *>> & plist)
+{
+	std::vector<std::pair<pdf *, context *>> leaf;
+	std::function<void(pdf *, context *)> expand = [&](pdf * p, context * c) {
+		std::vector<pdf *> comp = p->components();
+		for (pdf * q: comp) {
+			expand(q, c);
+		}
+		if (comp.empty() && std::find(leaf.begin(), leaf.end(), std::make_pair(p, c)) == leaf.end()) {
+			leaf.push_back(std::make_pair(p, c));
+		}
+	};
+	for (const std::pair<pdf *, context *> & pc: plist) {
+		expand(pc.first, pc.second);
+	}
+
+	std::vector<dataset *> normsets;
+	std::vector<std::vector<std::pair<pdf *, context *>>> group;
+	for (const std::pair<pdf *, context *> & pc: leaf) {
+		pdf * p = pc.first;
+		if (pc.second) pc.second->activate();
+		bool todo = p->m_normset && p->m_normset->size() && (!p->get_cache().normalized || p->updated());
+		double s = 0;
+		bool analytic = todo && p->analytic_sum(s);
+		if (analytic) p->set_norm(s);
+		if (pc.second) pc.second->deactivate();
+		if (!todo || analytic) continue;
+		size_t g = std::find(normsets.begin(), normsets.end(), p->norm_source()) - normsets.begin();
+		if (g == normsets.size()) {
+			normsets.push_back(p->norm_source());
+			group.emplace_back();
+		}
+		group[g].push_back(pc);
+	}
+
+	for (size_t g = 0; g < normsets.size(); ++g) {
+		dataset * ns = normsets[g];
+		std::vector<std::pair<pdf *, context *>> & todo = group[g];
+		PROFILE_SCOPE(ns, "normalize[fused]");
+		PROFILE_ADD(norm_calc, todo.size());
+		PROFILE_ADD(events, ns->size()*todo.size());
+		PROFILE_ADD(bytes, ns->size()*(ns->dim()+1)*sizeof(double));
+		tracer::span span("normalize[fused]", "pdf", "pdfs", todo.size());
+
+		// each block is evaluated by all pdfs while it is in cache; partial sums are kept per chunk and added in
+		// order, and the first chunk is summed before the others are handed out, so that caches a pdf fills on its
+		// first evaluation (projpdf bin sums) are not filled by several threads at once
+		size_t nchunk = (ns->size() + chunk_size - 1) / chunk_size;
+		std::vector<double> partial(nchunk*todo.size(), 0);
+		auto sum_chunk = [&](size_t chunk) {
+			std::vector<double> val(block_size);
+			size_t end = std::min((chunk+1)*chunk_size, ns->size());
+			for (size_t b = chunk*chunk_size; b < end; b += block_size) {
+				size_t e = std::min(b+block_size, end);
+				ns->wait(e);
+				for (size_t k = 0; k < todo.size(); ++k) {
+					if (todo[k].second) todo[k].second->activate();
+					todo[k].first->evaluate_batch(ns, b, e, &val[0]);
+					double s = 0;
+					for (size_t u = b; u < e; ++u) {
+						double v = val[u-b];
+						if (v >= 0) s += v * ns->weight(u);
+					}
+					partial[chunk*todo.size()+k] += s;
+					if (todo[k].second) todo[k].second->deactivate();
+				}
+			}
+		};
+		if (nchunk) sum_chunk(0);
+		parallel::for_each(nchunk ? nchunk-1 : 0, [&](size_t begin, size_t end) {
+			for (size_t chunk = begin; chunk < end; ++chunk) {
+				sum_chunk(chunk+1);
+			}
+		});
 
-		double s = sum(m_normset);
-		if (s == 0) return 1;
-		else {
-			m_norm = m_normset->nevt()/s;
-			m_normalized = true;
-			update_lastvalue();
-			return 0;
+		for (size_t k = 0; k < todo.size(); ++k) {
+			double s = 0;
+			for (size_t chunk = 0; chunk < nchunk; ++chunk) {
+				s += partial[chunk*todo.size()+k];
+			}
+			if (todo[k].second) todo[k].second->activate();
+			todo[k].first->set_norm(s);
+			if (todo[k].second) todo[k].second->deactivate();
 		}
 	}
-	return m_status;
 }
 
 double pdf::operator()(double * x)
@@ -192,11 +519,74 @@ double pdf::operator()(double * x)
 	return norm()*evaluate(x);
 }
 
+// norm from the sum of the pdf over its normset, returns the status; sums start before a normset is fully
+// loaded (see dataset::load), its total weight is only checked here
+int pdf::set_norm(double s)
+{
+	normcache & c = get_cache();
+	if (!m_normset->nevt()) {
+		c.normalized = false;
+		c.norm = 1;
+		c.status = -1;
+		return c.status;
+	}
+	c.normalized = (s != 0);
+	c.norm = c.normalized ? m_normset->nevt()/s : 1;
+	c.status = c.normalized ? 0 : 1;
+	if (c.normalized) update_lastvalue();
+	return c.status;
+}
+
+// values of evaluate over data at the current parameter values, evaluated once and shared by everyone asking for
+// the same data and values; the array lives as long as one of them holds it
+std::shared_ptr<pdf::precomputed> pdf::precompute(dataset * data)
+{
+	std::vector<double> par = get_pars();
+	{
+		std::shared_lock<std::shared_mutex> lock(m_precomputed->mutex);
+		for (std::weak_ptr<precomputed> & w: m_precomputed->list) {
+			std::shared_ptr<precomputed> p = w.lock();
+			if (p && p->data == data && p->par == par) return p;
+		}
+	}
+
+	tracer::span span("precompute", "pdf", "events", data->size());
+	std::shared_ptr<precomputed> p(new precomputed{data, par, std::vector<double>(data->size())});
+	// the first block is evaluated before the others are handed out, so that caches a pdf fills on its first
+	// evaluation (projpdf bin sums) are not filled by several threads at once
+	size_t first = std::min(block_size, data->size());
+	data->wait(first);
+	evaluate_batch(data, 0, first, &p->val[0]);
+	parallel::for_each(data->size()-first, [&](size_t begin, size_t end) {
+		data->wait(first+end);
+		evaluate_batch(data, first+begin, first+end, &p->val[first+begin]);
+	}, block_size);
+
+	std::unique_lock<std::shared_mutex> lock(m_precomputed->mutex);
+	std::vector<std::weak_ptr<precomputed>> & list = m_precomputed->list;
+	list.erase(std::remove_if(list.begin(), list.end(), [](const std::weak_ptr<precomputed> & w) { return w.expired(); }), list.end());
+	list.push_back(p);
+	return p;
+}
+
+// normalization (and integral) on the normset condensed into nbin cells per observable of the pdf, each cell
+// one event at the weighted mean (or centre) of its events; nbin = 0 goes back to the full normset.
+// Returns the relative error of the normset sum at the current values
+double pdf::set_binned_norm(size_t nbin, bool mean)
+{
+	m_binned.reset();
+	get_cache().normalized = false;
+	if (!nbin || !m_normset || !m_dim) return 0;
+	m_binned = m_normset->condense(m_dim, nbin, mean);
+	return binned_norm_error();
+}
+
 void pdf::set_normset(dataset & normset)
 {
 	if (m_normset != &normset) {
 		m_normset = &normset;
-		m_normalized = false;
+		m_binned.reset();
+		get_cache().normalized = false;
 	}
 }
 
@@ -204,27 +594,66 @@ double pdf::sum(dataset * data)
 {
 	if (!data) return 0;
 
+	PROFILE_SCOPE(this, "sum");
+	PROFILE_ADD(events, data->size());
+	PROFILE_ADD(bytes, data->size()*(data->dim()+1)*sizeof(double));
 	double s = 0;
-	for (size_t u = 0; u < data->size(); ++u) {
-		double v = evaluate(data->at(u));
-		if (v >= 0) s += v * data->weight(u);
+	std::vector<double> val(block_size);
+	for (size_t b = 0; b < data->size(); b += block_size) {
+		size_t e = std::min(b+block_size, data->size());
+		data->wait(e);
+		evaluate_batch(data, b, e, &val[0]);
+		for (size_t u = b; u < e; ++u) {
+			double v = val[u-b];
+			if (v >= 0) s += v * data->weight(u);
+		}
+	}
+	return s;
+}
+
+std::vector<double> pdf::sum(dataset * data, const std::vector<context *> & ctx)
+{
+	std::vector<double> s(ctx.size(), 0);
+	if (!data) return s;
+
+	PROFILE_SCOPE(this, "sum[n]");
+	PROFILE_ADD(events, data->size()*ctx.size());
+	PROFILE_ADD(bytes, data->size()*(data->dim()+1)*sizeof(double));
+	std::vector<double> val(block_size);
+	for (size_t b = 0; b < data->size(); b += block_size) {
+		size_t e = std::min(b+block_size, data->size());
+		data->wait(e);
+		for (size_t k = 0; k < ctx.size(); ++k) {
+			ctx[k]->activate();
+			evaluate_batch(data, b, e, &val[0]);
+			for (size_t u = b; u < e; ++u) {
+				double v = val[u-b];
+				if (v >= 0) s[k] += v * data->weight(u);
+			}
+			ctx[k]->deactivate();
+		}
 	}
 	return s;
 }
 
 void pdf::update_lastvalue()
 {
+	std::vector<double> & lastvalue = get_cache().lastvalue;
 	for (size_t u = 0; u < m_varlist.size(); ++u) {
-		m_lastvalue[u] = m_varlist.at(u)->value();
+		lastvalue[u] = m_varlist.at(u)->value();
 	}
 }
 
 bool pdf::updated()
 {
+	std::vector<double> & lastvalue = get_cache().lastvalue;
 	for (size_t u = 0; u < m_varlist.size(); ++u) {
-		if (m_varlist.at(u)->value() != m_lastvalue.at(u)) {
+		if (m_varlist.at(u)->value() != lastvalue.at(u)) {
 			return true;
 		}
 	}
 	return false;
 }
+
+size_t pdf::block_size = 1024;
+size_t pdf::chunk_size = 65536;
@@ -3,65 +3,127 @@
 
 #include <vector>
 #include <memory>
+#include <shared_mutex>
+#include <utility>
 #include "TH1.h"
 #include "TH2.h"
+#include "fitresult.h"
 
 class chi2fcn;
+class context;
 class datahist;
 class dataset;
 class nllfcn;
+class sampler;
 class variable;
 
 class pdf
 {
+	public:
+		// values of evaluate over a dataset at fixed parameter values, kept alive by the fcns that use them
+		struct precomputed
+		{
+			dataset * data;
+			std::vector<double> par;
+			std::vector<double> val;
+		};
+
 	public:
 		pdf(size_t dim, const std::vector<variable *> & vlist, dataset & normset);
 		pdf(const pdf & p) = default;
 		pdf & operator=(const pdf & p) = default;
 		virtual ~pdf();
 		
-		void chi2fit(datahist & data, bool minos_err = false);
+		fitresult chi2fit(datahist & data, bool minos_err = false);
+		bool constant(); // no parameter is floating
 		chi2fcn * create_chi2(datahist * data);
 		nllfcn * create_nll(dataset * data);
 		size_t dim() { return m_dim; }
 		void draw(TH1 * h, TH1 * hnorm = 0, const char * option = "hist same");
 		void draw(TH2 * h, TH2 * hnorm = 0, const char * option = "hist same");
-		void fit(dataset & data, bool minos_err = false);
+		fitresult fit(dataset & data, bool minos_err = false);
+		std::shared_ptr<dataset> generate(size_t n, unsigned seed = 1);
 		double get_lastvalue(int n);
 		std::vector<double> & get_lastvalues();
 		double get_par(int n);
+		std::vector<double> get_pars(); // values of all parameters, packed in the order of get_vars
+		bool get_precomputed(dataset * data, size_t begin, size_t end, double * out);
+		std::shared_ptr<sampler> get_sampler();
 		variable * get_var(int n);
 		std::vector<variable *> & get_vars();
 		dataset * normset() { return m_normset; }
 		size_t npar() { return m_varlist.size(); }
 		double operator()(double * x);
+		std::shared_ptr<precomputed> precompute(dataset * data);
+		fitresult refit(dataset & data, bool minos_err = false);
 		
+		virtual bool analytic_integral(const double * lo, const double * hi, double & value) { return false; } // integral of evaluate over a box, if known in closed form
+		virtual double binned_norm_error();
+		virtual std::vector<pdf *> components() { return std::vector<pdf *>(); } // pdfs this one is built from
 		virtual double evaluate(const double * x) = 0;
+		virtual double evaluate(const double * x, const double * par) { return evaluate(x); } // with the parameters from get_pars
+		virtual void evaluate_batch(dataset * data, size_t begin, size_t end, double * out);
+		virtual void evaluate_indexed(dataset * data, const std::vector<size_t> & index, double * out);
 		virtual double integral(double a, double b, int n = 0);
 		virtual double log_sum(dataset * data);
+		virtual double log_sum(dataset * data, size_t begin, size_t end);
+		virtual std::vector<double> log_sum(dataset * data, const std::vector<context *> & ctx);
 		virtual double nevt() { return 1; }
 		virtual double norm();
+		virtual std::vector<double> norm(const std::vector<context *> & ctx);
+		virtual double set_binned_norm(size_t nbin, bool mean = true);
 		virtual void set_normset(dataset & normset);
 		virtual double sum(dataset * data);
+		virtual std::vector<double> sum(dataset * data, const std::vector<context *> & ctx);
 		virtual bool updated(); // check whether parameters' values are changed or not since last call
 		
 		static double calculate_area(TH1 * h);
+		static void normalize_all(const std::vector<std::pair<pdf *, context *>> & plist);
+		
+		static size_t block_size; // events per block in multi-point passes, chosen to stay in cache
+		static size_t chunk_size; // events per task in the fused normalization pass
+
+	protected:
+		// everything that depends on parameter values, a copy of it is kept by each active context
+		struct normcache
+		{
+			bool normalized;
+			int status;
+			double norm;
+			std::vector<double> lastvalue;
+		};
+
+		struct samplercache
+		{
+			std::vector<double> par;
+			std::shared_ptr<sampler> table;
+		};
+
+		struct precomputedlist
+		{
+			std::shared_mutex mutex;
+			std::vector<std::weak_ptr<precomputed>> list;
+		};
 
 	protected:
 		pdf();
+		bool analytic_sum(double & s);
+		normcache & get_cache();
+		dataset * norm_source() { return m_binned ? m_binned.get() : m_normset; } // what the norm is summed over
 		virtual void update_lastvalue();
 		int normalize();
+		int set_norm(double s);
 
 	protected:
-		bool m_normalized;
 		size_t m_dim;
-		int m_status;
-		double m_norm;
-		std::vector<double> m_lastvalue;
+		normcache m_cache;
 		std::vector<variable *> m_varlist;
 		std::shared_ptr<chi2fcn> m_chi2;
 		std::shared_ptr<nllfcn> m_nll;
 		dataset * m_normset;
+		std::shared_ptr<dataset> m_binned; // surrogate of the normset, see set_binned_norm
+		samplercache m_sampler;
+		std::shared_ptr<precomputedlist> m_precomputed;
 };
 
 #endif
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cxxabi.h>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include "profiler.h"
+
+profiler::scope::~scope()
+{
+	m_count[nsec] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+	for (int f = 0; f < nfield; ++f) {
+		if (m_count[f]) profiler::add(m_entry, field(f), m_count[f]);
+	}
+}
+
+bool profiler::enabled()
+{
+#ifdef MSFIT_PROFILE
+	return true;
+#else
+	return false;
+#endif
+}
+
+// entries are created once under the lock, every thread keeps its own lookup table afterwards
+profiler::entry * profiler::get(const void * owner, const char * type, const char * stage)
+{
+	static thread_local std::map<std::pair<const void *, const char *>, entry *> local;
+	entry *& e = local[std::make_pair(owner, stage)];
+	if (!e) {
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		std::unique_ptr<entry> & p = entry_pool[std::make_pair(owner, std::string(stage))];
+		if (!p) {
+			p.reset(new entry);
+			p->owner = owner;
+			p->type = type;
+			p->stage = stage;
+			for (int f = 0; f < nfield; ++f) p->count[f] = 0;
+		}
+		e = p.get();
+	}
+	return e;
+}
+
+void profiler::report(std::ostream & os)
+{
+	if (!enabled()) {
+		os << "[profiler] warning: compiled without MSFIT_PROFILE, nothing was recorded" << std::endl;
+	}
+
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	std::vector<entry *> list;
+	for (auto & p: entry_pool) {
+		list.push_back(p.second.get());
+	}
+	std::sort(list.begin(), list.end(), [](entry * a, entry * b) { return a->count[nsec] > b->count[nsec]; });
+
+	os << std::left << std::setw(32) << "object" << std::setw(16) << "stage" << std::right;
+	os << std::setw(10) << "calls" << std::setw(14) << "events" << std::setw(14) << "MB";
+	os << std::setw(10) << "norm" << std::setw(10) << "reused" << std::setw(10) << "hit" << std::setw(10) << "miss" << std::setw(12) << "ms" << std::endl;
+	for (entry * e: list) {
+		int err = 0;
+		char * demangled = abi::__cxa_demangle(e->type, 0, 0, &err);
+		std::ostringstream name;
+		name << (err ? e->type : demangled) << "@" << e->owner;
+		free(demangled);
+		os << std::left << std::setw(32) << name.str() << std::setw(16) << e->stage << std::right;
+		os << std::setw(10) << e->count[calls] << std::setw(14) << e->count[events] << std::setw(14) << std::fixed << std::setprecision(2) << e->count[bytes]/1e6;
+		os << std::setw(10) << e->count[norm_calc] << std::setw(10) << e->count[norm_reuse] << std::setw(10) << e->count[cache_hit] << std::setw(10) << e->count[cache_miss];
+		os << std::setw(12) << e->count[nsec]/1e6 << std::endl;
+		os.unsetf(std::ios::fixed);
+		os << std::setprecision(6);
+	}
+}
+
+void profiler::reset()
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	for (auto & p: entry_pool) {
+		for (int f = 0; f < nfield; ++f) p.second->count[f] = 0;
+	}
+}
+
+std::mutex profiler::pool_mutex;
+std::map<std::pair<const void *, std::string>, std::unique_ptr<profiler::entry>> profiler::entry_pool;
@@ -0,0 +1,71 @@
+#ifndef PROFILER_H__
+#define PROFILER_H__
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <utility>
+
+// counters for the hot paths, recorded per object (pdf, fcn, dataset) and stage;
+// the PROFILE_* macros expand to nothing unless MSFIT_PROFILE is defined before including the headers
+class profiler
+{
+	public:
+		enum field { calls, events, bytes, norm_calc, norm_reuse, cache_hit, cache_miss, nsec, nfield };
+
+		struct entry
+		{
+			const void * owner;
+			const char * type;
+			const char * stage;
+			std::atomic<unsigned long long> count[nfield];
+		};
+
+		// times its own lifetime and adds the counts collected meanwhile in one go
+		class scope
+		{
+			public:
+				template <typename T> scope(const T * owner, const char * stage);
+				virtual ~scope();
+				void add(field f, unsigned long long n) { m_count[f] += n; }
+
+			private:
+				entry * m_entry;
+				unsigned long long m_count[nfield];
+				std::chrono::steady_clock::time_point m_start;
+		};
+
+	public:
+		static void add(entry * e, field f, unsigned long long n) { e->count[f].fetch_add(n, std::memory_order_relaxed); }
+		static bool enabled();
+		static entry * get(const void * owner, const char * type, const char * stage);
+		static void report(std::ostream & os = std::cout);
+		static void reset();
+
+	private:
+		static std::mutex pool_mutex;
+		static std::map<std::pair<const void *, std::string>, std::unique_ptr<entry>> entry_pool;
+};
+
+template <typename T> profiler::scope::scope(const T * owner, const char * stage):
+	m_entry(get(owner, typeid(*owner).name(), stage)),
+	m_count{0},
+	m_start(std::chrono::steady_clock::now())
+{
+	m_count[calls] = 1;
+}
+
+#ifdef MSFIT_PROFILE
+#define PROFILE_SCOPE(owner, stage) profiler::scope profile_scope__(owner, stage)
+#define PROFILE_ADD(f, n) profile_scope__.add(profiler::f, n)
+#else
+#define PROFILE_SCOPE(owner, stage)
+#define PROFILE_ADD(f, n)
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+#include <iostream>
+#include <cmath>
+#include "dataset.h"
+#include "parallel.h"
+#include "pdf.h"
+#include "profiler.h"
+#include "projection.h"
+#include "tracer.h"
+
+projection::projection(dataset * data):
+	m_data(data)
+{
+}
+
+projection::~projection()
+{
+}
+
+void projection::add(TH1 * h, size_t x, pdf * p, bool normalized)
+{
+	add_target(h, x, 0, false, p ? add_weight(p, normalized, 0) : -1);
+}
+
+void projection::add(TH1 * h, std::function<double(double *)> weight_func, size_t x)
+{
+	add_target(h, x, 0, false, add_weight(0, false, weight_func));
+}
+
+void projection::add(TH2 * h, size_t x, size_t y, pdf * p, bool normalized)
+{
+	add_target(h, x, y, true, p ? add_weight(p, normalized, 0) : -1);
+}
+
+void projection::add(TH2 * h, std::function<double(double *)> weight_func, size_t x, size_t y)
+{
+	add_target(h, x, y, true, add_weight(0, false, weight_func));
+}
+
+void projection::add_target(TH1 * h, size_t x, size_t y, bool twod, int weight)
+{
+	if (x >= m_data->dim() || (twod && y >= m_data->dim())) {
+		std::cout << "[projection] error: out of allowed dimension 0 ~ " << m_data->dim()-1 << std::endl;
+		return;
+	}
+	int nx = h->GetNbinsX()+2;
+	int ny = twod ? h->GetNbinsY()+2 : 1;
+	m_target.push_back({h, x, y, twod, nx*ny, nx, weight});
+}
+
+// histograms weighted by the same pdf share its evaluation
+int projection::add_weight(pdf * p, bool normalized, std::function<double(double *)> func)
+{
+	if (p) {
+		if (p->dim() > m_data->dim()) {
+			std::cout << "[projection] error: pdf has more dimensions than the dataset" << std::endl;
+			return -1;
+		}
+		for (size_t u = 0; u < m_weight.size(); ++u) {
+			if (m_weight[u].p == p && m_weight[u].normalized == normalized) return u;
+		}
+	}
+	m_weight.push_back({p, normalized, func});
+	return m_weight.size()-1;
+}
+
+void projection::fill()
+{
+	size_t n = m_data->size();
+	tracer::span span("projection", "data", "events", n);
+	PROFILE_SCOPE(this, "fill");
+	PROFILE_ADD(events, n);
+	PROFILE_ADD(bytes, n*(m_data->dim()+1)*sizeof(double));
+
+	// norms are settled here, the pass itself only reads them
+	std::vector<double> scale(m_weight.size(), 1);
+	for (size_t k = 0; k < m_weight.size(); ++k) {
+		if (m_weight[k].p && m_weight[k].normalized) scale[k] = m_weight[k].p->norm();
+		else if (m_weight[k].p) m_weight[k].p->norm();
+	}
+
+	// sum of weights and of squared weights per cell, for each group of consecutive slices and histogram: the
+	// groups are a fixed number, so that the memory does not grow with the dataset, and each is filled in order
+	size_t nslice = (n + slice_size - 1) / slice_size;
+	size_t ngroup = std::min(nslice, max_groups);
+	std::vector<std::vector<double>> sumw(ngroup*m_target.size());
+	std::vector<std::vector<double>> sumw2(ngroup*m_target.size());
+	parallel::for_each(ngroup, [&](size_t begin, size_t end) {
+		std::vector<std::vector<double>> val(m_weight.size(), std::vector<double>(pdf::block_size));
+		for (size_t g = begin; g < end; ++g) {
+			for (size_t t = 0; t < m_target.size(); ++t) {
+				sumw[g*m_target.size()+t].assign(m_target[t].ncell, 0);
+				sumw2[g*m_target.size()+t].assign(m_target[t].ncell, 0);
+			}
+			size_t gbegin = g*nslice/ngroup*slice_size;
+			size_t gend = std::min((g+1)*nslice/ngroup*slice_size, n);
+			for (size_t b = gbegin; b < gend; b += pdf::block_size) {
+				size_t e = std::min(b+pdf::block_size, gend);
+				m_data->wait(e);
+				for (size_t k = 0; k < m_weight.size(); ++k) {
+					if (m_weight[k].p) {
+						m_weight[k].p->evaluate_batch(m_data, b, e, &val[k][0]);
+						for (size_t u = 0; u < e-b; ++u) {
+							val[k][u] *= scale[k];
+						}
+					}
+					else {
+						for (size_t u = b; u < e; ++u) {
+							val[k][u-b] = m_weight[k].func(m_data->at(u));
+						}
+					}
+				}
+				for (size_t t = 0; t < m_target.size(); ++t) {
+					const target & tg = m_target[t];
+					TAxis * xaxis = tg.hist->GetXaxis();
+					TAxis * yaxis = tg.hist->GetYaxis();
+					std::vector<double> & sw = sumw[g*m_target.size()+t];
+					std::vector<double> & sw2 = sumw2[g*m_target.size()+t];
+					for (size_t u = b; u < e; ++u) {
+						const double * x = m_data->at(u);
+						double w = m_data->weight(u) * (tg.weight >= 0 ? val[tg.weight][u-b] : 1);
+						int bin = xaxis->FindFixBin(x[tg.x]);
+						if (tg.twod) bin += tg.nx*yaxis->FindFixBin(x[tg.y]);
+						sw[bin] += w;
+						sw2[bin] += w*w;
+					}
+				}
+			}
+		}
+	});
+
+	// groups are added in order, the histograms do not depend on the number of threads
+	for (size_t t = 0; t < m_target.size(); ++t) {
+		TH1 * h = m_target[t].hist;
+		h->Reset();
+		for (int c = 0; c < m_target[t].ncell; ++c) {
+			double w = 0;
+			double w2 = 0;
+			for (size_t g = 0; g < ngroup; ++g) {
+				w += sumw[g*m_target.size()+t][c];
+				w2 += sumw2[g*m_target.size()+t][c];
+			}
+			h->SetBinContent(c, w);
+			h->SetBinError(c, sqrt(w2));
+		}
+		h->SetEntries(n);
+	}
+}
+
+size_t projection::slice_size = 65536;
+size_t projection::max_groups = 64;
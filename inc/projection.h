@@ -0,0 +1,63 @@
+#ifndef PROJECTION_H__
+#define PROJECTION_H__
+
+#include <functional>
+#include <vector>
+#include "TH1.h"
+#include "TH2.h"
+
+class dataset;
+class pdf;
+
+// fills any number of histograms from one dataset in a single parallel pass: each group of consecutive slices
+// is filled into lightweight histograms of its own, which are added to the TH1/TH2 in order at the end; pdf
+// weights are evaluated once per block of events with the batch path, shared by all histograms weighted by the
+// same pdf
+class projection
+{
+	public:
+		projection(dataset * data);
+		projection(const projection & p) = delete;
+		projection & operator=(const projection & p) = delete;
+		virtual ~projection();
+
+		void add(TH1 * h, size_t x = 0, pdf * p = 0, bool normalized = true);
+		void add(TH1 * h, std::function<double(double *)> weight_func, size_t x = 0);
+		void add(TH2 * h, size_t x = 0, size_t y = 1, pdf * p = 0, bool normalized = true);
+		void add(TH2 * h, std::function<double(double *)> weight_func, size_t x = 0, size_t y = 1);
+		void fill();
+
+		static size_t slice_size; // events per slice, the unit of work of the pass
+		static size_t max_groups; // groups of slices with histograms of their own, the memory is bounded by it
+
+	protected:
+		struct target
+		{
+			TH1 * hist;
+			size_t x;
+			size_t y;
+			bool twod;
+			int ncell; // bins including under- and overflow
+			int nx; // bins along x including under- and overflow
+			int weight; // index in m_weight, -1 for the event weight only
+		};
+
+		// per-event factor on top of the event weight, either a pdf (normalized or raw) or a user function
+		struct weight
+		{
+			pdf * p;
+			bool normalized;
+			std::function<double(double *)> func;
+		};
+
+	protected:
+		int add_weight(pdf * p, bool normalized, std::function<double(double *)> func);
+		void add_target(TH1 * h, size_t x, size_t y, bool twod, int weight);
+
+	protected:
+		dataset * m_data;
+		std::vector<target> m_target;
+		std::vector<weight> m_weight;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include "dataset.h"
+#include "parallel.h"
+#include "projindex.h"
+
+projindex::projindex(dataset * normset, const std::vector<size_t> & pdim, const std::vector<std::vector<double>> & binning, const std::vector<size_t> & cols):
+	m_dim(normset->dim()),
+	m_normset(normset),
+	m_binning(binning),
+	m_col(sorted_columns(normset, cols)),
+	m_pdim(pdim)
+{
+	assert(m_col.back() < m_dim);
+	assert(pdim.size() > 0 && pdim.size() == binning.size());
+	size_t nbin = 1;
+	for (size_t u = 0; u < pdim.size(); ++u) {
+		assert(pdim[u] < m_dim && binning[u].size() > 1);
+		nbin *= binning[u].size()-1;
+	}
+	m_offset.assign(nbin+1, 0);
+	m_volume.assign(nbin, 1);
+	for (size_t bin = 0; bin < nbin; ++bin) {
+		size_t b = bin;
+		for (size_t u = 0; u < m_binning.size(); ++u) {
+			size_t nb = m_binning[u].size()-1;
+			m_volume[bin] *= m_binning[u][b % nb + 1] - m_binning[u][b % nb];
+			b /= nb;
+		}
+	}
+	init();
+}
+
+projindex::~projindex()
+{
+}
+
+// x holds the projected coordinates, the first axis runs fastest in the global bin number
+int projindex::find_bin(const double * x)
+{
+	int bin = 0;
+	int stride = 1;
+	for (size_t u = 0; u < m_binning.size(); ++u) {
+		int b = find_bin(x[u], u);
+		if (b < 0) return -1;
+		bin += b*stride;
+		stride *= m_binning[u].size()-1;
+	}
+	return bin;
+}
+
+int projindex::find_bin(double x, size_t n)
+{
+	const std::vector<double> & edge = m_binning[n];
+	if (x < edge.front() || x >= edge.back()) return -1;
+	return std::upper_bound(edge.begin(), edge.end(), x) - edge.begin() - 1;
+}
+
+// event n with the copied columns at their normset positions: x has room for dim() values, the columns not
+// copied are left as they are; when all columns are copied the row is returned directly
+const double * projindex::row(size_t n, double * x)
+{
+	if (m_col.size() == m_dim) return at(n);
+	const double * a = at(n);
+	for (size_t u = 0; u < m_col.size(); ++u) {
+		x[m_col[u]] = a[u];
+	}
+	return x;
+}
+
+// an index built before events were appended to the normset is not handed out again, projpdfs created
+// afterwards get a new one
+std::shared_ptr<projindex> projindex::get(dataset * normset, const std::vector<size_t> & pdim, const std::vector<std::vector<double>> & binning, const std::vector<size_t> & cols)
+{
+	auto key = std::make_tuple(normset, pdim, binning, sorted_columns(normset, cols));
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	std::shared_ptr<projindex> p = index_pool[key].lock();
+	if (!p || p->m_nevt != normset->size()) {
+		p.reset(new projindex(normset, pdim, binning, cols));
+		index_pool[key] = p;
+	}
+	return p;
+}
+
+void projindex::init()
+{
+	// counting sort of normset events by bin: events of one bin end up adjacent in memory
+	m_nevt = m_normset->size();
+	std::vector<int> bin(m_nevt);
+	// chunks of a normset still being loaded are binned as they arrive
+	parallel::for_each(m_normset->size(), [&](size_t begin, size_t end) {
+		m_normset->wait(end);
+		std::vector<double> x(m_pdim.size());
+		for (size_t u = begin; u < end; ++u) {
+			for (size_t v = 0; v < m_pdim.size(); ++v) {
+				x[v] = m_normset->at(u)[m_pdim[v]];
+			}
+			bin[u] = find_bin(&x[0]);
+		}
+	}, 4096);
+	for (size_t u = 0; u < m_normset->size(); ++u) {
+		if (bin[u] >= 0) ++m_offset[bin[u]+1];
+	}
+	for (size_t u = 1; u < m_offset.size(); ++u) {
+		m_offset[u] += m_offset[u-1];
+	}
+
+	size_t ncol = m_col.size();
+	m_arr.resize(m_offset.back()*ncol);
+	m_weight.resize(m_offset.back());
+	std::vector<size_t> pos(m_offset.begin(), m_offset.end()-1);
+	for (size_t u = 0; u < m_normset->size(); ++u) {
+		if (bin[u] < 0) continue;
+		size_t n = pos[bin[u]]++;
+		for (size_t v = 0; v < ncol; ++v) {
+			m_arr[n*ncol+v] = m_normset->at(u)[m_col[v]];
+		}
+		m_weight[n] = m_normset->weight(u);
+	}
+}
+
+// sorted without duplicates, empty stands for all columns of the normset
+std::vector<size_t> projindex::sorted_columns(dataset * normset, std::vector<size_t> cols)
+{
+	if (cols.empty()) {
+		for (size_t u = 0; u < normset->dim(); ++u) cols.push_back(u);
+	}
+	std::sort(cols.begin(), cols.end());
+	cols.erase(std::unique(cols.begin(), cols.end()), cols.end());
+	return cols;
+}
+
+std::mutex projindex::pool_mutex;
+std::map<std::tuple<dataset *, std::vector<size_t>, std::vector<std::vector<double>>, std::vector<size_t>>, std::weak_ptr<projindex>> projindex::index_pool;
@@ -0,0 +1,62 @@
+#ifndef PROJINDEX_H__
+#define PROJINDEX_H__
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+class dataset;
+
+// bin-sorted copy of the columns of a normset that func_weight reads (all of them unless given), shared by all
+// projpdfs with the same normset, projected dimensions, binning and columns
+class projindex
+{
+	public:
+		projindex(dataset * normset, const std::vector<size_t> & pdim, const std::vector<std::vector<double>> & binning, const std::vector<size_t> & cols);
+		projindex(const projindex & p) = delete;
+		projindex & operator=(const projindex & p) = delete;
+		virtual ~projindex();
+
+		const double * at(size_t n) { return &m_arr[n*m_col.size()]; } // the copied columns only
+		const std::vector<size_t> & columns() { return m_col; }
+		size_t bin_begin(int bin) { return m_offset[bin]; }
+		size_t bin_end(int bin) { return m_offset[bin+1]; }
+		double bin_volume(int bin) { return m_volume[bin]; }
+		const std::vector<double> & binning(size_t n = 0) { return m_binning[n]; }
+		size_t dim() { return m_dim; }
+		int find_bin(const double * x);
+		int find_bin(double x, size_t n = 0);
+		size_t ncol() { return m_col.size(); }
+		size_t nbin() { return m_offset.size()-1; }
+		dataset * normset() { return m_normset; }
+		size_t pdim() { return m_pdim.size(); }
+		const double * row(size_t n, double * x);
+		size_t size() { return m_weight.size(); }
+		double weight(size_t n) { return m_weight[n]; }
+
+		static std::shared_ptr<projindex> get(dataset * normset, const std::vector<size_t> & pdim, const std::vector<std::vector<double>> & binning, const std::vector<size_t> & cols = {});
+
+	protected:
+		void init();
+
+		static std::vector<size_t> sorted_columns(dataset * normset, std::vector<size_t> cols);
+
+	protected:
+		size_t m_dim;
+		dataset * m_normset;
+		std::vector<double> m_arr;
+		std::vector<std::vector<double>> m_binning;
+		std::vector<size_t> m_col; // normset columns held in m_arr
+		size_t m_nevt; // normset size the index was built for
+		std::vector<size_t> m_offset;
+		std::vector<size_t> m_pdim;
+		std::vector<double> m_volume; // of each bin
+		std::vector<double> m_weight;
+
+		static std::mutex pool_mutex;
+		static std::map<std::tuple<dataset *, std::vector<size_t>, std::vector<std::vector<double>>, std::vector<size_t>>, std::weak_ptr<projindex>> index_pool;
+};
+
+#endif
@@ -1,81 +1,158 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include "context.h"
 #include "dataset.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "projindex.h"
 #include "projpdf.h"
 #include "variable.h"
 		
-projpdf::projpdf(const std::vector<variable *> & vlist, dataset & normset, size_t pdim, size_t nbin, double lo, double hi):
+projpdf::projpdf(const std::vector<variable *> & vlist, dataset & normset, size_t pdim, size_t nbin, double lo, double hi, const std::vector<size_t> & cols):
 	pdf(1, vlist, normset)
 {
 	assert(pdim < normset.dim() && nbin > 0);
 	double xlo = (lo < hi) ? lo : hi;
 	double xhi = (lo < hi) ? hi : lo;
 	double step = (xhi-xlo)/nbin;
+	std::vector<double> binning;
 	for (size_t u = 0; u <= nbin; ++u) {
-		m_binning.push_back(xlo + u*step);
-		if (u > 0) {
-			m_bin_data.push_back(std::vector<double *>(0));
-			m_bin_weight.push_back(std::vector<double>(0));
-		}
+		binning.push_back(xlo + u*step);
 	}
-	init(pdim);
+	init({pdim}, {binning}, cols);
 }
 
-projpdf::projpdf(const std::vector<variable *> & vlist, dataset & normset, size_t pdim, size_t nbin, const double * binning):
+projpdf::projpdf(const std::vector<variable *> & vlist, dataset & normset, size_t pdim, size_t nbin, const double * binning, const std::vector<size_t> & cols):
 	pdf(1, vlist, normset)
 {
 	assert(pdim < normset.dim() && nbin > 0);
-	for (size_t u = 0; u <= nbin; ++u) {
-		m_binning.push_back(binning[u]);
-		if (u > 0) {
-			m_bin_data.push_back(std::vector<double *>(0));
-			m_bin_weight.push_back(std::vector<double>(0));
-		}
-	}
-	init(pdim);
+	init({pdim}, {std::vector<double>(binning, binning+nbin+1)}, cols);
+}
+
+projpdf::projpdf(const std::vector<variable *> & vlist, dataset & normset, const std::vector<size_t> & pdim, const std::vector<std::vector<double>> & binning, const std::vector<size_t> & cols):
+	pdf(pdim.size(), vlist, normset)
+{
+	assert(pdim.size() > 0 && pdim.size() == binning.size());
+	init(pdim, binning, cols);
 }
 
 projpdf::~projpdf()
 {
 }
 
+// the histogram is recreated with the binning of the index, the name is copied before the old one is deleted
 void projpdf::draw(TH1 * h, TH1 * hnorm, const char * option)
 {
-	const char * name = h->GetName();
+	std::string name = h->GetName();
 	if (h->IsOnHeap()) delete h;
-	h = new TH1F(name, "", m_binning.size()-1, &m_binning[0]);
+	h = new TH1F(name.c_str(), "", m_index->binning(0).size()-1, &m_index->binning(0)[0]);
+	pdf::draw(h, hnorm, option);
+}
+
+void projpdf::draw(TH2 * h, TH2 * hnorm, const char * option)
+{
+	if (m_dim != 2) {
+		std::cout << "[projpdf] error: only 2d projection can plot 2d hist" << std::endl;
+		return;
+	}
+
+	std::string name = h->GetName();
+	if (h->IsOnHeap()) delete h;
+	const std::vector<double> & xb = m_index->binning(0);
+	const std::vector<double> & yb = m_index->binning(1);
+	h = new TH2F(name.c_str(), "", xb.size()-1, &xb[0], yb.size()-1, &yb[0]);
 	pdf::draw(h, hnorm, option);
 }
 
 double projpdf::evaluate(const double * x)
 {
-	double v = 0;
-	int bin = find_bin(x[0]);
-	if (bin >= 0) {
-		for (size_t u = 0; u < m_bin_data[bin].size(); ++u) {
-			double * xx = m_bin_data[bin][u];
-			double w = m_bin_weight[bin][u];
-			v += func_weight(xx) * w;
-		}
-		v /= (m_binning[bin+1] - m_binning[bin]);
+	int bin = find_bin(x);
+	if (bin < 0) return 0;
+	return update_binsum().sum[bin] / m_index->bin_volume(bin);
+}
+
+double projpdf::evaluate(const double * x, const double * par)
+{
+	int bin = find_bin(x);
+	if (bin < 0) return 0;
+	return update_binsum(par).sum[bin] / m_index->bin_volume(bin);
+}
+
+// the bin sums are looked up once for the whole range, cache hits are counted here rather than per event
+void projpdf::evaluate_batch(dataset * data, size_t begin, size_t end, double * out)
+{
+	PROFILE_SCOPE(this, "evaluate_batch");
+	PROFILE_ADD(events, end-begin);
+	std::vector<double> par = get_pars();
+	bool hit = false;
+	const std::vector<double> & sum = update_binsum(par.data(), &hit).sum;
+	PROFILE_ADD(cache_hit, hit);
+	for (size_t u = begin; u < end; ++u) {
+		int bin = find_bin(data->at(u));
+		out[u-begin] = (bin < 0) ? 0 : sum[bin] / m_index->bin_volume(bin);
+	}
+}
+
+projpdf::bincache & projpdf::get_bincache()
+{
+	context * c = context::current();
+	return c ? c->state(&m_bincache, m_bincache) : m_bincache;
+}
+
+int projpdf::find_bin(const double * x)
+{
+	return m_index->find_bin(x);
+}
+
+void projpdf::init(const std::vector<size_t> & pdim, const std::vector<std::vector<double>> & binning, const std::vector<size_t> & cols)
+{
+	for (size_t c: cols) {
+		assert(c < m_normset->dim());
 	}
-	return v;
+	m_index = projindex::get(m_normset, pdim, binning, cols);
+	m_bincache.sum.assign(m_index->nbin(), 0);
 }
 
-int projpdf::find_bin(double x)
+// the current values are compared with the cached ones in place, a lookup (once per event) allocates nothing
+projpdf::bincache & projpdf::update_binsum()
 {
-	for (size_t u = 0; u < m_binning.size()-1; ++u) {
-		if (x >= m_binning[u] && x < m_binning[u+1]) return u;
+	bincache & c = get_bincache();
+	bool current = c.par.size() == m_varlist.size();
+	for (size_t u = 0; current && u < m_varlist.size(); ++u) {
+		current = (c.par[u] == m_varlist[u]->value());
 	}
-	return -1;
+	if (current) return c;
+	std::vector<double> par = get_pars();
+	return update_binsum(par.data());
 }
 
-void projpdf::init(size_t pdim)
+// sum of func_weight over each bin, refreshed in parallel whenever a parameter has changed; the refresh writes
+// the cache of the current context, callers running on several threads refresh it before handing out the work.
+// Only the refresh is profiled, lookups run once per event on some paths
+projpdf::bincache & projpdf::update_binsum(const double * par, bool * hit)
 {
-	for (size_t u = 0; u < m_normset->size(); ++u) {
-		double x = m_normset->at(u)[pdim];
-		int bin = find_bin(x);
-		if (bin >= 0) {
-			m_bin_data[bin].push_back(m_normset->at(u));
-			m_bin_weight[bin].push_back(m_normset->weight(u));
+	bincache & c = get_bincache();
+	bool current = c.par.size() == npar() && std::equal(c.par.begin(), c.par.end(), par);
+	if (hit) *hit = current;
+	if (current) return c;
+
+	PROFILE_SCOPE(this, "binsum");
+	PROFILE_ADD(cache_miss, 1);
+	tracer::span span("binsum", "pdf", "events", m_index->size());
+	PROFILE_ADD(events, m_index->size());
+	PROFILE_ADD(bytes, m_index->size()*(m_index->ncol()+1)*sizeof(double));
+	parallel::for_each(m_index->nbin(), [&](size_t begin, size_t end) {
+		std::vector<double> x(m_index->dim(), 0);
+		for (size_t u = begin; u < end; ++u) {
+			double v = 0;
+			for (size_t w = m_index->bin_begin(u); w < m_index->bin_end(u); ++w) {
+				v += func_weight(m_index->row(w, &x[0]), par) * m_index->weight(w);
+			}
+			c.sum[u] = v;
 		}
-	}
+	});
+	c.par.assign(par, par+npar());
+	return c;
 }
@@ -2,34 +2,51 @@
 #define PROJPDF_H__
 
 #include <vector>
+#include <memory>
 #include "pdf.h"
 
-class variable;
 class dataset;
+class projindex;
+class variable;
 
 class projpdf: public pdf
 {
 	public:
-		projpdf(const std::vector<variable *> & vlist, dataset & normset, size_t pdim, size_t nbin, double lo, double hi);
-		projpdf(const std::vector<variable *> & vlist, dataset & normset, size_t pdim, size_t nbin, const double * binning);
+		// cols: the normset columns func_weight reads, all of them if empty
+		projpdf(const std::vector<variable *> & vlist, dataset & normset, size_t pdim, size_t nbin, double lo, double hi, const std::vector<size_t> & cols = {});
+		projpdf(const std::vector<variable *> & vlist, dataset & normset, size_t pdim, size_t nbin, const double * binning, const std::vector<size_t> & cols = {});
+		projpdf(const std::vector<variable *> & vlist, dataset & normset, const std::vector<size_t> & pdim, const std::vector<std::vector<double>> & binning, const std::vector<size_t> & cols = {});
 		virtual ~projpdf();
 		
 		void draw(TH1 * h, TH1 * hnorm = 0, const char * option = "hist same");
-		void draw(TH2 * h, TH2 * hnorm = 0, const char * option = "hist same") = delete;
+		void draw(TH2 * h, TH2 * hnorm = 0, const char * option = "hist same");
 
 		// override pdf
 		virtual double evaluate(const double * x);
+		virtual double evaluate(const double * x, const double * par);
+		virtual void evaluate_batch(dataset * data, size_t begin, size_t end, double * out);
 		
 		virtual double func_weight(const double * x) = 0;
+		virtual double func_weight(const double * x, const double * par) { return func_weight(x); } // with the parameters from get_pars
+
+	protected:
+		// sum of func_weight per bin and the parameter values it was calculated with
+		struct bincache
+		{
+			std::vector<double> par;
+			std::vector<double> sum;
+		};
 
 	protected:
-		int find_bin(double x);
-		void init(size_t pdim);
+		int find_bin(const double * x);
+		bincache & get_bincache();
+		void init(const std::vector<size_t> & pdim, const std::vector<std::vector<double>> & binning, const std::vector<size_t> & cols);
+		bincache & update_binsum();
+		bincache & update_binsum(const double * par, bool * hit = 0);
 
 	protected:
-		std::vector<double> m_binning;
-		std::vector<std::vector<double *>> m_bin_data;
-		std::vector<std::vector<double>> m_bin_weight;
+		std::shared_ptr<projindex> m_index;
+		bincache m_bincache;
 };
 
 #endif
@@ -0,0 +1,98 @@
+#include <cmath>
+#include <iostream>
+#include "TRandom3.h"
+#include "dataset.h"
+#include "parallel.h"
+#include "sampler.h"
+
+sampler::sampler(dataset * source, const std::vector<double> & weight):
+	m_source(source),
+	m_total(0),
+	m_alias(weight.size()),
+	m_prob(weight.size())
+{
+	size_t nchunk = std::max<size_t>(1, std::min<size_t>(4*parallel::nthread(), weight.size()/4096));
+	for (size_t c = 0; c <= nchunk; ++c) {
+		m_offset.push_back(c*weight.size()/nchunk);
+	}
+
+	std::vector<double> chunk_total(nchunk, 0);
+	parallel::for_each(nchunk, [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			size_t b = m_offset[c];
+			chunk_total[c] = build(&weight[b], m_offset[c+1]-b, &m_prob[b], &m_alias[b]);
+		}
+	});
+	m_top_prob.resize(nchunk);
+	m_top_alias.resize(nchunk);
+	m_total = build(&chunk_total[0], nchunk, &m_top_prob[0], &m_top_alias[0]);
+}
+
+sampler::~sampler()
+{
+}
+
+// Vose's method on [0, n): returns the sum of the weights, alias holds indices relative to the range
+double sampler::build(const double * weight, size_t n, double * prob, size_t * alias)
+{
+	double total = 0;
+	for (size_t u = 0; u < n; ++u) {
+		total += weight[u];
+	}
+	std::vector<size_t> small, large;
+	for (size_t u = 0; u < n; ++u) {
+		alias[u] = u;
+		prob[u] = (total > 0) ? weight[u]*n/total : 0;
+		if (prob[u] < 1) small.push_back(u);
+		else large.push_back(u);
+	}
+	while (!small.empty() && !large.empty()) {
+		size_t s = small.back();
+		size_t l = large.back();
+		small.pop_back();
+		alias[s] = l;
+		prob[l] -= 1-prob[s];
+		if (prob[l] < 1) {
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	// left-overs are 1 up to rounding
+	for (size_t u: large) prob[u] = 1;
+	for (size_t u: small) prob[u] = (total > 0) ? 1 : 0;
+	return total;
+}
+
+// index of an event, r1 and r2 uniform in [0, 1)
+size_t sampler::draw(double r1, double r2)
+{
+	size_t nchunk = m_top_prob.size();
+	double x = r1*nchunk;
+	size_t c = std::min<size_t>(x, nchunk-1);
+	if (x-c >= m_top_prob[c]) c = m_top_alias[c];
+
+	size_t b = m_offset[c];
+	size_t n = m_offset[c+1]-b;
+	x = r2*n;
+	size_t k = std::min<size_t>(x, n-1);
+	return b + ((x-k < m_prob[b+k]) ? k : m_alias[b+k]);
+}
+
+// n events of the source (with weight 1) in O(n)
+std::shared_ptr<dataset> sampler::generate(size_t n, TRandom3 & rndm)
+{
+	size_t dim = m_source->dim();
+	std::shared_ptr<dataset> d(new dataset(n, dim));
+	if (m_total <= 0) {
+		std::cout << "[sampler] error: all weights are zero" << std::endl;
+		return d;
+	}
+	for (size_t u = 0; u < n; ++u) {
+		double r1 = rndm.Rndm();
+		double r2 = rndm.Rndm();
+		const double * x = m_source->at(draw(r1, r2));
+		std::copy(x, x+dim, d->at(u));
+		d->set_weight(u, 1);
+	}
+	return d;
+}
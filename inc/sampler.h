@@ -0,0 +1,40 @@
+#ifndef SAMPLER_H__
+#define SAMPLER_H__
+
+#include <memory>
+#include <vector>
+
+class TRandom3;
+class dataset;
+
+// Walker/Vose alias table over the events of a dataset with non-negative weights: a draw costs two uniform
+// numbers and one comparison; the table is made of independent tables over chunks of events (built in parallel)
+// and one small table choosing the chunk
+class sampler
+{
+	public:
+		sampler(dataset * source, const std::vector<double> & weight);
+		sampler(const sampler & s) = delete;
+		sampler & operator=(const sampler & s) = delete;
+		virtual ~sampler();
+
+		size_t draw(double r1, double r2);
+		std::shared_ptr<dataset> generate(size_t n, TRandom3 & rndm);
+		size_t size() { return m_prob.size(); }
+		dataset * source() { return m_source; }
+		double total() { return m_total; }
+
+	private:
+		static double build(const double * weight, size_t n, double * prob, size_t * alias);
+
+	private:
+		dataset * m_source;
+		double m_total;
+		std::vector<size_t> m_alias;
+		std::vector<size_t> m_offset;
+		std::vector<double> m_prob;
+		std::vector<size_t> m_top_alias;
+		std::vector<double> m_top_prob;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include "Minuit2/FunctionMinimum.h"
+#include "Minuit2/MnMigrad.h"
+#include "Minuit2/MnUserParameters.h"
+#include "context.h"
+#include "fcn.h"
+#include "parallel.h"
+#include "scan.h"
+#include "tracer.h"
+#include "variable.h"
+
+scan::scan(fcn * f):
+	m_fcn(f),
+	m_fmin(0),
+	m_nx(0),
+	m_x(0),
+	m_y(0)
+{
+}
+
+scan::~scan()
+{
+}
+
+void scan::draw(TH1 * h, const char * option)
+{
+	h->Reset();
+	for (size_t u = 0; u < m_point.size(); ++u) {
+		if (m_point[u].valid) h->SetBinContent(h->FindBin(m_point[u].x), delta(u));
+	}
+	h->Draw(option);
+}
+
+void scan::draw(TH2 * h, const char * option)
+{
+	h->Reset();
+	for (size_t u = 0; u < m_point.size(); ++u) {
+		if (m_point[u].valid) h->SetBinContent(h->FindBin(m_point[u].x, m_point[u].y), delta(u));
+	}
+	h->Draw(option);
+}
+
+// ranges of a 1d scan where fval-fmin stays below nsigma^2*Up, ends are interpolated linearly between grid points
+std::vector<std::pair<double, double>> scan::interval(double nsigma)
+{
+	std::vector<std::pair<double, double>> result;
+	if (m_y) {
+		std::cout << "[scan] error: intervals are only available for 1d scans" << std::endl;
+		return result;
+	}
+
+	double level = nsigma*nsigma*m_fcn->Up();
+	std::vector<size_t> idx;
+	for (size_t u = 0; u < m_point.size(); ++u) {
+		if (m_point[u].valid) idx.push_back(u);
+	}
+	std::sort(idx.begin(), idx.end(), [this](size_t a, size_t b) { return m_point[a].x < m_point[b].x; });
+	bool inside = false;
+	double lo = 0;
+	for (size_t k = 0; k < idx.size(); ++k) {
+		double x = m_point[idx[k]].x;
+		double d = delta(idx[k]);
+		if (!inside && d < level) {
+			inside = true;
+			lo = x;
+			if (k > 0) {
+				double x0 = m_point[idx[k-1]].x;
+				double d0 = delta(idx[k-1]);
+				lo = x0 + (level-d0)/(d-d0)*(x-x0);
+			}
+		}
+		else if (inside && d >= level) {
+			inside = false;
+			double x0 = m_point[idx[k-1]].x;
+			double d0 = delta(idx[k-1]);
+			result.push_back(std::make_pair(lo, x0 + (level-d0)/(d-d0)*(x-x0)));
+		}
+	}
+	if (inside) result.push_back(std::make_pair(lo, m_point[idx.back()].x));
+	return result;
+}
+
+// minimum over the free parameters with the scanned ones fixed at the point
+void scan::minimize(fcn * f, point & p, const std::vector<double> & start)
+{
+	tracer::span span("point", "scan");
+	std::vector<variable *> & vlist = f->get_var_list();
+	ROOT::Minuit2::MnUserParameters upar;
+	size_t nfree = 0;
+	for (size_t u = 0; u < vlist.size(); ++u) {
+		variable * v = vlist[u];
+		double val = (v == m_x) ? p.x : (v == m_y) ? p.y : start[u];
+		upar.Add(v->name(), val, v->err());
+		upar.SetLimits(v->name(), v->limit_down(), v->limit_up());
+		if (v == m_x || v == m_y) upar.Fix(v->name());
+		else ++nfree;
+	}
+
+	p.value = start;
+	if (nfree == 0) {
+		for (size_t u = 0; u < vlist.size(); ++u) {
+			p.value[u] = (vlist[u] == m_x) ? p.x : (vlist[u] == m_y) ? p.y : start[u];
+		}
+		p.fval = (*f)(p.value);
+		p.valid = true;
+		return;
+	}
+	ROOT::Minuit2::MnMigrad migrad(*f, upar);
+	ROOT::Minuit2::FunctionMinimum min = migrad();
+	for (size_t u = 0; u < vlist.size(); ++u) {
+		p.value[u] = min.UserState().Value(vlist[u]->name());
+	}
+	p.fval = min.Fval();
+	p.valid = min.IsValid();
+}
+
+void scan::run(variable * x, const std::vector<double> & xgrid)
+{
+	m_x = x;
+	m_y = 0;
+	m_nx = xgrid.size();
+	m_point.clear();
+	for (double vx: xgrid) {
+		m_point.push_back({vx, 0, 0, false, {}});
+	}
+	start();
+}
+
+void scan::run(variable * x, const std::vector<double> & xgrid, variable * y, const std::vector<double> & ygrid)
+{
+	m_x = x;
+	m_y = y;
+	m_nx = xgrid.size();
+	m_point.clear();
+	for (double vy: ygrid) {
+		for (double vx: xgrid) {
+			m_point.push_back({vx, vy, 0, false, {}});
+		}
+	}
+	start();
+}
+
+// strip: consecutive points along x, visited outwards from the one closest to the current value of x
+void scan::run_strip(const std::vector<size_t> & strip, const std::vector<double> & start)
+{
+	context ctx(context::current());
+	ctx.activate();
+	std::unique_ptr<fcn> f(m_fcn->clone());
+	f->set_verbose(false);
+
+	double x0 = m_x->value();
+	size_t first = 0;
+	for (size_t k = 1; k < strip.size(); ++k) {
+		if (fabs(m_point[strip[k]].x - x0) < fabs(m_point[strip[first]].x - x0)) first = k;
+	}
+	minimize(f.get(), m_point[strip[first]], start);
+	for (size_t k = first+1; k < strip.size(); ++k) {
+		minimize(f.get(), m_point[strip[k]], m_point[strip[k-1]].value);
+	}
+	for (size_t k = first; k-- > 0;) {
+		minimize(f.get(), m_point[strip[k]], m_point[strip[k+1]].value);
+	}
+	ctx.deactivate();
+}
+
+void scan::start()
+{
+	std::vector<variable *> & vlist = m_fcn->get_var_list();
+	if (std::find(vlist.begin(), vlist.end(), m_x) == vlist.end() || (m_y && std::find(vlist.begin(), vlist.end(), m_y) == vlist.end())) {
+		std::cout << "[scan] error: scanned parameters must be floating parameters of the fcn" << std::endl;
+		m_point.clear();
+		return;
+	}
+	std::vector<double> start;
+	for (variable * v: vlist) {
+		start.push_back(v->value());
+	}
+
+	// 2d: one strip per row, 1d: the grid is cut into one strip per thread
+	std::vector<std::vector<size_t>> strips;
+	size_t nstrip = m_y ? m_point.size()/m_nx : std::min(parallel::nthread(), m_nx);
+	for (size_t s = 0; s < nstrip; ++s) {
+		size_t b = m_y ? s*m_nx : s*m_nx/nstrip;
+		size_t e = m_y ? (s+1)*m_nx : (s+1)*m_nx/nstrip;
+		strips.push_back(std::vector<size_t>());
+		for (size_t u = b; u < e; ++u) {
+			strips.back().push_back(u);
+		}
+	}
+	parallel::for_each(strips.size(), [&](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; ++s) {
+			if (!strips[s].empty()) run_strip(strips[s], start);
+		}
+	});
+
+	// differences are taken to the global minimum (the last fit of the fcn) rather than to the best grid point,
+	// which lies off the minimum unless it falls on the grid; the grid minimum is used without a fit, or if it
+	// is lower
+	double gmin = std::numeric_limits<double>::max();
+	for (point & p: m_point) {
+		if (p.valid) gmin = std::min(gmin, p.fval);
+	}
+	m_fmin = m_fcn->min_fval();
+	if (std::isnan(m_fmin)) {
+		m_fmin = gmin;
+	}
+	else if (gmin < m_fmin) {
+		std::cout << "[scan] warning: grid minimum " << gmin << " is below the fit minimum " << m_fmin << ", the fit has not converged to the global minimum" << std::endl;
+		m_fmin = gmin;
+	}
+}
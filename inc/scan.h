@@ -0,0 +1,58 @@
+#ifndef SCAN_H__
+#define SCAN_H__
+
+#include <utility>
+#include <vector>
+#include "TH1.h"
+#include "TH2.h"
+
+class fcn;
+class variable;
+
+// profile likelihood scan over a 1d or 2d grid of one or two parameters of an fcn, the other parameters are
+// minimized at every point; the grid is split into strips (rows in 2d) run on worker threads, each with a clone
+// of the fcn in its own context, and points are visited outwards from the current value, each starting from
+// the minimum of its neighbour
+class scan
+{
+	public:
+		struct point
+		{
+			double x;
+			double y;
+			double fval;
+			bool valid;
+			std::vector<double> value; // all parameters of the fcn at the minimum
+		};
+
+	public:
+		scan(fcn * f);
+		scan(const scan & s) = delete;
+		scan & operator=(const scan & s) = delete;
+		virtual ~scan();
+
+		double delta(size_t n) { return m_point[n].fval - m_fmin; }
+		void draw(TH1 * h, const char * option = "hist");
+		void draw(TH2 * h, const char * option = "colz");
+		double fmin() { return m_fmin; }
+		point & get_point(size_t n) { return m_point[n]; }
+		std::vector<std::pair<double, double>> interval(double nsigma = 1);
+		size_t npoint() { return m_point.size(); }
+		void run(variable * x, const std::vector<double> & xgrid);
+		void run(variable * x, const std::vector<double> & xgrid, variable * y, const std::vector<double> & ygrid);
+
+	protected:
+		void minimize(fcn * f, point & p, const std::vector<double> & start);
+		void run_strip(const std::vector<size_t> & strip, const std::vector<double> & start);
+		void start();
+
+	protected:
+		fcn * m_fcn;
+		double m_fmin;
+		std::vector<point> m_point;
+		size_t m_nx;
+		variable * m_x;
+		variable * m_y;
+};
+
+#endif
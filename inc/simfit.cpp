@@ -1,5 +1,6 @@
 #include <iostream>
 #include "chi2fcn.h"
+#include "context.h"
 #include "datahist.h"
 #include "dataset.h"
 #include "nllfcn.h"
@@ -21,10 +22,11 @@ void simfit::add(pdf & p, dataset & d)
 	m_dlist.push_back(&d);
 }
 
-void simfit::chi2fit(bool minos_err)
+fitresult simfit::chi2fit(bool minos_err)
 {
 	chi2fcn * chi2 = create_chi2();
-	if (chi2) chi2->minimize(minos_err);
+	if (chi2) return chi2->minimize(minos_err);
+	return fitresult();
 }
 
 nllfcn * simfit::create_nll()
@@ -50,8 +52,23 @@ chi2fcn * simfit::create_chi2()
 	return m_chi2.get();
 }
 
-void simfit::fit(bool minos_err)
+fitresult simfit::fit(bool minos_err)
 {
+	// inside a context the fcn belongs to this call only, see pdf::fit
+	if (context::current()) {
+		nllfcn nll;
+		for (size_t u = 0; u < m_plist.size(); ++u) {
+			nll.add(m_plist[u], m_dlist[u]);
+		}
+		return nll.minimize(minos_err);
+	}
 	nllfcn * nll = create_nll();
-	nll->minimize(minos_err);
+	return nll->minimize(minos_err);
+}
+
+// fit after events were appended to the datasets, with the nll of the last fit if no channel was added since
+fitresult simfit::refit(bool minos_err)
+{
+	if (context::current() || !m_nll || m_nll->get_data_list().size() != m_dlist.size()) return fit(minos_err);
+	return m_nll->refit(minos_err);
 }
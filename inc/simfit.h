@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <memory>
+#include "fitresult.h"
 
 class addpdf;
 class chi2fcn;
@@ -17,10 +18,11 @@ class simfit
 		virtual ~simfit();
 		
 		void add(pdf & p, dataset & d);
-		void chi2fit(bool minos_err = false);
+		fitresult chi2fit(bool minos_err = false);
 		nllfcn * create_nll();
 		chi2fcn * create_chi2();
-		void fit(bool minos_err = false);
+		fitresult fit(bool minos_err = false);
+		fitresult refit(bool minos_err = false);
 
 	protected:
 		std::vector<dataset *> m_dlist;
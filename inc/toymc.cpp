@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include "TRandom3.h"
+#include "context.h"
+#include "dataset.h"
+#include "nllfcn.h"
+#include "parallel.h"
+#include "pdf.h"
+#include "sampler.h"
+#include "toymc.h"
+#include "tracer.h"
+#include "variable.h"
+
+toymc::toymc(pdf * p, double nevt, bool poisson):
+	m_nevt(nevt),
+	m_poisson(poisson),
+	m_pdf(p)
+{
+	for (variable * v: p->get_vars()) {
+		if (!v->constant() && std::find(m_varlist.begin(), m_varlist.end(), v) == m_varlist.end()) {
+			m_varlist.push_back(v);
+		}
+	}
+}
+
+toymc::~toymc()
+{
+}
+
+// fitted minus generating value of parameter n, for the toys whose fit converged
+std::vector<double> toymc::bias(int n)
+{
+	std::vector<double> b;
+	for (fitresult & r: m_result) {
+		if (r.valid()) b.push_back(r.value(n) - m_truth[n]);
+	}
+	return b;
+}
+
+// one toy at the values of the last run (or the current values before any run), the same seed gives the same toy
+std::shared_ptr<dataset> toymc::generate(unsigned seed)
+{
+	if (!m_sampler) init();
+	if (!m_sampler) return std::shared_ptr<dataset>();
+	TRandom3 rndm(seed);
+	size_t n = m_poisson ? rndm.Poisson(m_nevt) : size_t(m_nevt + 0.5);
+	return m_sampler->generate(n, rndm);
+}
+
+// the current values become the generating values, the alias table is built once and shared by all toys
+void toymc::init()
+{
+	m_truth.clear();
+	for (variable * v: m_varlist) {
+		m_truth.push_back(v->value());
+	}
+	m_sampler = m_pdf->get_sampler();
+}
+
+void toymc::print(std::ostream & os)
+{
+	size_t nvalid = 0;
+	for (fitresult & r: m_result) {
+		if (r.valid()) ++nvalid;
+	}
+	os << "toys: " << m_result.size() << ", converged: " << nvalid << std::endl;
+	for (size_t u = 0; u < m_varlist.size(); ++u) {
+		std::vector<double> b = bias(u);
+		std::vector<double> p = pull(u);
+		double bm = 0, pm = 0, ps = 0;
+		for (double x: b) bm += x/b.size();
+		for (double x: p) pm += x/p.size();
+		for (double x: p) ps += (x-pm)*(x-pm)/p.size();
+		os << std::setw(12) << m_varlist[u]->name() << " true " << std::setw(12) << m_truth[u] << " bias " << std::setw(12) << bm;
+		os << " pull mean " << std::setw(10) << pm << " +- " << std::setw(10) << (p.empty() ? 0 : sqrt(ps/p.size()));
+		os << " width " << std::setw(10) << sqrt(ps) << std::endl;
+	}
+}
+
+// (fitted - generating value)/error of parameter n, with the minos error on the side of the generating value if there is one
+std::vector<double> toymc::pull(int n)
+{
+	std::vector<double> p;
+	for (fitresult & r: m_result) {
+		if (!r.valid()) continue;
+		double d = r.value(n) - m_truth[n];
+		double e = r.err(n);
+		if (d < 0 && r.err_up(n)) e = fabs(r.err_up(n));
+		else if (d > 0 && r.err_down(n)) e = fabs(r.err_down(n));
+		if (e > 0) p.push_back(d/e);
+	}
+	return p;
+}
+
+// toy u is generated with seed+u, so results do not depend on the number of threads
+void toymc::run(size_t ntoy, unsigned seed, bool minos_err)
+{
+	init();
+	m_result.assign(ntoy, fitresult());
+	context * parent = context::current();
+	parallel::for_each(ntoy, [&](size_t begin, size_t end) {
+		for (size_t u = begin; u < end; ++u) {
+			tracer::span span("toy", "toymc", "toy", u);
+			std::shared_ptr<dataset> d = generate(seed+u);
+			context ctx(parent);
+			ctx.activate();
+			nllfcn nll(m_pdf, d.get());
+			nll.set_verbose(false);
+			m_result[u] = nll.minimize(minos_err);
+			ctx.deactivate();
+		}
+	});
+}
@@ -0,0 +1,47 @@
+#ifndef TOYMC_H__
+#define TOYMC_H__
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "fitresult.h"
+
+class dataset;
+class pdf;
+class sampler;
+class variable;
+
+// toy experiments for a pdf: events of its normset are drawn (alias table) with probability weight*pdf at the
+// generating values, and each toy is fitted on a worker thread in its own context, starting from those values
+class toymc
+{
+	public:
+		toymc(pdf * p, double nevt, bool poisson = true);
+		toymc(const toymc & t) = delete;
+		toymc & operator=(const toymc & t) = delete;
+		virtual ~toymc();
+
+		std::vector<double> bias(int n);
+		std::shared_ptr<dataset> generate(unsigned seed);
+		size_t ntoy() { return m_result.size(); }
+		void print(std::ostream & os = std::cout);
+		std::vector<double> pull(int n);
+		fitresult & result(size_t n) { return m_result[n]; }
+		void run(size_t ntoy, unsigned seed = 1, bool minos_err = false);
+		double truth(int n) { return m_truth[n]; }
+		variable * get_var(int n) { return m_varlist[n]; }
+
+	protected:
+		void init();
+
+	protected:
+		double m_nevt;
+		bool m_poisson;
+		pdf * m_pdf;
+		std::vector<fitresult> m_result;
+		std::shared_ptr<sampler> m_sampler;
+		std::vector<double> m_truth;
+		std::vector<variable *> m_varlist;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include <fstream>
+#include <iostream>
+#include "tracer.h"
+
+tracer::span::span(const char * name, const char * cat, const char * arg_name, long arg):
+	m_active(active()),
+	m_name(name),
+	m_cat(cat),
+	m_arg_name(arg_name),
+	m_arg(arg)
+{
+	if (m_active) m_begin = std::chrono::steady_clock::now();
+}
+
+tracer::span::~span()
+{
+	if (m_active) record(m_name, m_cat, m_begin, std::chrono::steady_clock::now(), m_arg_name, m_arg);
+}
+
+void tracer::clear()
+{
+	std::lock_guard<std::mutex> lock(event_mutex);
+	event_list.clear();
+}
+
+void tracer::record(const char * name, const char * cat, time_point begin, time_point end, const char * arg_name, long arg)
+{
+	if (!active()) return;
+	event e;
+	e.name = name;
+	e.cat = cat;
+	e.tid = thread_id();
+	e.begin = std::chrono::duration<double, std::micro>(begin - origin).count();
+	e.dur = std::chrono::duration<double, std::micro>(end - begin).count();
+	e.arg_name = arg_name;
+	e.arg = arg;
+	std::lock_guard<std::mutex> lock(event_mutex);
+	event_list.push_back(e);
+}
+
+void tracer::start()
+{
+	std::lock_guard<std::mutex> lock(event_mutex);
+	if (event_list.empty()) origin = std::chrono::steady_clock::now();
+	on = true;
+}
+
+void tracer::stop()
+{
+	on = false;
+}
+
+// threads are numbered in the order they first record something, the thread calling start() is usually 0
+int tracer::thread_id()
+{
+	static thread_local int id = thread_count++;
+	return id;
+}
+
+bool tracer::write(const char * filename)
+{
+	std::ofstream os(filename);
+	if (!os) {
+		std::cout << "[tracer] error: cannot open " << filename << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(event_mutex);
+	os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+	for (size_t u = 0; u < event_list.size(); ++u) {
+		const event & e = event_list[u];
+		os << "{\"name\": \"" << e.name << "\", \"cat\": \"" << e.cat << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.tid;
+		os << ", \"ts\": " << std::fixed << e.begin << ", \"dur\": " << e.dur;
+		if (e.arg_name) os << ", \"args\": {\"" << e.arg_name << "\": " << e.arg << "}";
+		os << "}" << (u+1 < event_list.size() ? "," : "") << std::endl;
+	}
+	os << "]}" << std::endl;
+	return true;
+}
+
+std::atomic<bool> tracer::on(false);
+std::atomic<int> tracer::thread_count(0);
+std::mutex tracer::event_mutex;
+std::vector<tracer::event> tracer::event_list;
+tracer::time_point tracer::origin = std::chrono::steady_clock::now();
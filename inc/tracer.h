@@ -0,0 +1,65 @@
+#ifndef TRACER_H__
+#define TRACER_H__
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// opt-in timeline of a fit: scoped spans with thread ids, written as chrome trace json
+// (chrome://tracing, ui.perfetto.dev); recording costs one atomic load while switched off
+class tracer
+{
+	public:
+		typedef std::chrono::steady_clock::time_point time_point;
+
+		struct event
+		{
+			const char * name;
+			const char * cat;
+			int tid;
+			double begin;
+			double dur;
+			const char * arg_name;
+			long arg;
+		};
+
+		// records the time between its construction and destruction, if tracing was on at construction
+		class span
+		{
+			public:
+				span(const char * name, const char * cat, const char * arg_name = 0, long arg = 0);
+				span(const span & s) = delete;
+				span & operator=(const span & s) = delete;
+				virtual ~span();
+
+			private:
+				bool m_active;
+				const char * m_name;
+				const char * m_cat;
+				const char * m_arg_name;
+				long m_arg;
+				time_point m_begin;
+		};
+
+	public:
+		static bool active() { return on.load(std::memory_order_relaxed); }
+		static void clear();
+		static void record(const char * name, const char * cat, time_point begin, time_point end, const char * arg_name = 0, long arg = 0);
+		static void start();
+		static void stop();
+		static bool write(const char * filename);
+
+	private:
+		static int thread_id();
+
+	private:
+		static std::atomic<bool> on;
+		static std::atomic<int> thread_count;
+		static std::mutex event_mutex;
+		static std::vector<event> event_list;
+		static time_point origin;
+};
+
+#endif
@@ -46,6 +46,8 @@ variable::~variable()
 
 void variable::add_to_pool()
 {
+	m_id = var_count++;
+	std::lock_guard<std::recursive_mutex> lock(pool_mutex);
 	if (var_pool.find(m_name) != var_pool.end()) {
 		std::cout << "warning: variable named [" << m_name << "] already exists, the old one will be overwritten" << std::endl;
 	}
@@ -54,6 +56,7 @@ void variable::add_to_pool()
 
 variable & variable::var(const char * name)
 {
+	std::lock_guard<std::recursive_mutex> lock(pool_mutex);
 	if (var_pool.find(name) == var_pool.end()) {
 		std::cout << "warning: variable named [" << name << "] does not exist, a new one will be created" << std::endl;
 		variable tmp(name);
@@ -62,3 +65,5 @@ variable & variable::var(const char * name)
 }
 
 std::map<const char *, variable *> variable::var_pool;
+std::atomic<size_t> variable::var_count(0);
+std::recursive_mutex variable::pool_mutex;
@@ -1,7 +1,10 @@
 #ifndef VARIABLE_H__
 #define VARIABLE_H__
 
+#include <atomic>
 #include <map>
+#include <mutex>
+#include "context.h"
 
 class variable
 {
@@ -12,25 +15,28 @@ class variable
 		virtual ~variable();
 		
 		bool constant() { return m_constant; }
-		double err() { return m_err; }
-		double err_down() { return m_err_down; }
-		double err_up() { return m_err_up; }
+		double err() { return get_err(m_err, 0); }
+		double err_down() { return get_err(m_err_down, 1); }
+		double err_up() { return get_err(m_err_up, 2); }
+		size_t id() { return m_id; }
 		double limit_down() { return m_limit_down; }
 		double limit_up() { return m_limit_up; }
 		const char * name() { return m_name; }
 		void set_constant(bool flag) { m_constant = flag; }
-		void set_err(double v) { m_err = v; }
-		void set_err_down(double v) { m_err_down = v; }
-		void set_err_up(double v) { m_err_up = v; }
+		void set_err(double v) { set_err(m_err, 0, v); }
+		void set_err_down(double v) { set_err(m_err_down, 1, v); }
+		void set_err_up(double v) { set_err(m_err_up, 2, v); }
 		void set_limit_down(double v) { m_limit_down = v; }
 		void set_limit_up(double v) { m_limit_up = v; }
-		void set_value(double v) { m_value = v; }
-		double value() { return m_value; }
+		void set_value(double v);
+		double value();
 		
 		static variable & var(const char * name);
 	
 	private:
 		void add_to_pool();
+		double get_err(double & e, int n);
+		void set_err(double & e, int n, double v);
 
 	public:
 		bool m_constant;
@@ -41,8 +47,38 @@ class variable
 		double m_limit_up;
 		double m_value;
 		const char * m_name;
+		size_t m_id;
 		
 		static std::map<const char *, variable *> var_pool;
+		static std::atomic<size_t> var_count;
+		static std::recursive_mutex pool_mutex;
 };
 
+// values and errors of a fit running in a context are kept by the context
+inline double variable::get_err(double & e, int n)
+{
+	context * c = context::current();
+	return c ? c->err(m_id, n, e) : e;
+}
+
+inline void variable::set_err(double & e, int n, double v)
+{
+	context * c = context::current();
+	if (c) c->set_err(m_id, n, v);
+	else e = v;
+}
+
+inline void variable::set_value(double v)
+{
+	context * c = context::current();
+	if (c) c->set_value(m_id, v);
+	else m_value = v;
+}
+
+inline double variable::value()
+{
+	context * c = context::current();
+	return c ? c->value(m_id, m_value) : m_value;
+}
+
 #endif
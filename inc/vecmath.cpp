@@ -0,0 +1,130 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include "vecmath.h"
+
+namespace {
+	inline uint64_t to_bits(double x) { uint64_t b; std::memcpy(&b, &x, sizeof(b)); return b; }
+	inline double from_bits(uint64_t b) { double x; std::memcpy(&x, &b, sizeof(x)); return x; }
+}
+
+void vecmath::exp(const double * x, double * y, size_t n)
+{
+	exp(x, y, n, get_mode());
+}
+
+void vecmath::exp(const double * x, double * y, size_t n, mode m)
+{
+	if (m == strict) exp_kernel<false>(x, y, n);
+	else if (m == fast) exp_kernel<true>(x, y, n);
+	else for (size_t u = 0; u < n; ++u) y[u] = std::exp(x[u]);
+}
+
+// exp(x) = 2^k exp(r) with k = round(x/ln2) and |r| <= ln2/2 (Cody-Waite reduction, k*ln2_hi is exact); exp(r)
+// from its Taylor series up to r^13 (r^9 in fast mode), 2^k applied as two factors so that results down to the
+// subnormals need no branch
+template <bool FAST> void vecmath::exp_kernel(const double * x, double * y, size_t n)
+{
+	const double inv_ln2 = 0x1.71547652b82fep0;
+	const double ln2_hi = 0x1.62e42fee00000p-1;
+	const double ln2_lo = 0x1.a39ef35793c76p-33;
+	const double shift = 0x1.8p52; // adding it rounds to an integer, which is then in the low bits
+	for (size_t u = 0; u < n; ++u) {
+		// beyond these the result is inf or 0 anyway, NaN passes through the comparisons
+		double v = x[u] > 710.0 ? 710.0 : x[u];
+		v = v < -746.0 ? -746.0 : v;
+		double kd = v*inv_ln2 + shift;
+		int64_t k = int64_t(to_bits(kd) - to_bits(shift));
+		kd -= shift;
+		double r = (v - kd*ln2_hi) - kd*ln2_lo;
+		double q;
+		if (FAST) {
+			q = 1.0/40320 + r*(1.0/362880);
+			q = 1.0/5040 + r*q;
+			q = 1.0/720 + r*q;
+			q = 1.0/120 + r*q;
+		}
+		else {
+			q = 1.0/479001600 + r*(1.0/6227020800);
+			q = 1.0/39916800 + r*q;
+			q = 1.0/3628800 + r*q;
+			q = 1.0/362880 + r*q;
+			q = 1.0/40320 + r*q;
+			q = 1.0/5040 + r*q;
+			q = 1.0/720 + r*q;
+			q = 1.0/120 + r*q;
+		}
+		q = 1.0/24 + r*q;
+		q = 1.0/6 + r*q;
+		q = 0.5 + r*q;
+		double p = 1.0 + (r + r*r*q);
+		// 2^k1 * 2^k2 with k1 = floor(k/2), both normal for the clamped range of k
+		int64_t k1 = int64_t((uint64_t(k + 2048) >> 1)) - 1024;
+		double s1 = from_bits(uint64_t(k1 + 1023) << 52);
+		double s2 = from_bits(uint64_t(k - k1 + 1023) << 52);
+		y[u] = p*s1*s2;
+	}
+}
+
+void vecmath::log(const double * x, double * y, size_t n)
+{
+	log(x, y, n, get_mode());
+}
+
+void vecmath::log(const double * x, double * y, size_t n, mode m)
+{
+	if (m == strict) log_kernel<false>(x, y, n);
+	else if (m == fast) log_kernel<true>(x, y, n);
+	else for (size_t u = 0; u < n; ++u) y[u] = std::log(x[u]);
+}
+
+// log(x) = k ln2 + log(1+f) with 1+f in [sqrt(2)/2, sqrt(2)), log(1+f) = 2 atanh(s) with s = f/(2+f) from the
+// series in s^2 of fdlibm (up to s^14, s^10 in fast mode); special values are selected at the end
+template <bool FAST> void vecmath::log_kernel(const double * x, double * y, size_t n)
+{
+	const double ln2_hi = 0x1.62e42fee00000p-1;
+	const double ln2_lo = 0x1.a39ef35793c76p-33;
+	const double lg1 = 6.666666666666735130e-01;
+	const double lg2 = 3.999999999940941908e-01;
+	const double lg3 = 2.857142874366239149e-01;
+	const double lg4 = 2.222219843214978396e-01;
+	const double lg5 = 1.818357216161805012e-01;
+	const double lg6 = 1.531383769920937332e-01;
+	const double lg7 = 1.479819860511658591e-01;
+	const double inf = std::numeric_limits<double>::infinity();
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	for (size_t u = 0; u < n; ++u) {
+		double v = x[u];
+		// subnormals are scaled into the normal range
+		bool sub = v < 0x1p-1022;
+		double a = sub ? v*0x1p54 : v;
+		uint64_t b = to_bits(a);
+		// the exponent is converted through the mantissa of 2^52, there is no vector int64 to double conversion
+		double k = from_bits((b >> 52) | 0x4330000000000000ULL) - 0x1p52 - (sub ? 1077.0 : 1023.0);
+		uint64_t hx = (b >> 32) & 0xfffff;
+		bool big = hx >= 0x6a09c;
+		k = big ? k+1 : k;
+		double f = from_bits((b & 0x000fffffffffffffULL) | (big ? 0x3fe0000000000000ULL : 0x3ff0000000000000ULL)) - 1.0;
+		double s = f/(2.0+f);
+		double z = s*s;
+		double w = z*z;
+		double t1, t2;
+		if (FAST) {
+			t1 = w*(lg2+w*lg4);
+			t2 = z*(lg1+w*(lg3+w*lg5));
+		}
+		else {
+			t1 = w*(lg2+w*(lg4+w*lg6));
+			t2 = z*(lg1+w*(lg3+w*(lg5+w*lg7)));
+		}
+		double R = t2+t1;
+		double hfsq = 0.5*f*f;
+		// the two forms of fdlibm, the first one for 1+f near sqrt(2)
+		bool mid = hx >= 0x6147a && hx <= 0x6b851;
+		double r = mid ? k*ln2_hi - ((hfsq - (s*(hfsq+R) + k*ln2_lo)) - f) : k*ln2_hi - ((s*(f-R) - k*ln2_lo) - f);
+		y[u] = v > 0 ? (v < inf ? r : v) : (v == 0 ? -inf : nan);
+	}
+}
+
+std::atomic<int> vecmath::current(vecmath::strict);
@@ -0,0 +1,31 @@
+#ifndef VECMATH_H__
+#define VECMATH_H__
+
+#include <atomic>
+#include <cstddef>
+
+// exp and log of whole arrays for the event loops: straight-line code on the bits of the doubles, without
+// branches or table lookups, so that the compiler vectorizes the loops (-O3, see makefile). The mode is global:
+// libm calls std::exp/std::log, strict stays within 1 ulp, fast drops polynomial terms and stays within a
+// relative error of 1e-11 for exp and an absolute error of 2e-11 for log (what a sum of logs sees)
+class vecmath
+{
+	public:
+		enum mode { libm, strict, fast };
+
+		static void exp(const double * x, double * y, size_t n);
+		static void exp(const double * x, double * y, size_t n, mode m);
+		static mode get_mode() { return mode(current.load(std::memory_order_relaxed)); }
+		static void log(const double * x, double * y, size_t n);
+		static void log(const double * x, double * y, size_t n, mode m);
+		static void set_mode(mode m) { current.store(m, std::memory_order_relaxed); }
+
+	private:
+		template <bool FAST> static void exp_kernel(const double * x, double * y, size_t n);
+		template <bool FAST> static void log_kernel(const double * x, double * y, size_t n);
+
+	private:
+		static std::atomic<int> current;
+};
+
+#endif